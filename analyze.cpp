@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "player.hpp"
+using namespace std;
+
+// Analyses a stream of positions on all cores and prints one JSON line per
+// position, in input order.
+//
+// Each input line is a board of 64 characters in print_board order, with
+// 'b' and 'w' for discs and '-', '.' or ' ' for empty squares, then the side
+// to move (b or w). Blank lines and lines starting with '#' are skipped, so
+// bench_positions can be read as it is.
+//
+// Every position is searched to --depth, or for --time ms, or solved exactly
+// if it has --endgame empties or fewer. Each worker keeps its transposition
+// table from one position to the next, which helps with positions from the
+// same game but means a score can depend on what the worker saw before.
+//
+// Positions are read into a window a few times larger than the number of
+// workers, and a worker takes the next unclaimed one as soon as it is free.
+// A position that takes long holds back the output, not the workers, until
+// the window is full, so memory stays bounded however long the input is.
+
+struct Job {
+    int line_number;
+    bool valid;
+    Board board;
+    char side;
+    SearchResult result;
+    bool done;
+};
+
+static bool parse_position(const string& line, Job *job) {
+    if (line.size() < 66) return false;
+    char data[64];
+    for (int i = 0; i < 64; i++) {
+        char c = line[i];
+        if (c == BLACK || c == WHITE) data[i] = c;
+        else if (c == '-' || c == '.' || c == ' ') data[i] = ' ';
+        else return false;
+    }
+    size_t side = line.find_first_not_of(" \t", 64);
+    if (side == string::npos || (line[side] != BLACK && line[side] != WHITE)) return false;
+    job->board.setBoard(data);
+    job->side = line[side];
+    return true;
+}
+
+static void write_result(const Job& job) {
+    if (!job.valid) {
+        printf("{\"line\": %d, \"error\": \"bad position\"}\n", job.line_number);
+        return;
+    }
+    const SearchResult& result = job.result;
+    printf("{\"line\": %d, \"side\": \"%c\", \"empties\": %d, \"move\": \"%d,%d\", "
+        "\"score\": %d, \"depth\": %d, \"solved\": %s, \"nodes\": %llu, \"ms\": %lld}\n",
+        job.line_number, job.side, popcount(job.board.empties()),
+        result.best_move < 0 ? -1 : result.best_move % 8,
+        result.best_move < 0 ? -1 : result.best_move / 8, result.score, result.depth,
+        result.solved ? "true" : "false", (unsigned long long) result.nodes, result.ms);
+}
+
+int main(int argc, char *argv[]) {
+    const char *filename = nullptr;
+    int threads = 0, depth = 0, move_ms = 0, endgame = 0;
+    Evaluation evaluation = EVAL_PATTERNS;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--depth") && i + 1 < argc) depth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--time") && i + 1 < argc) move_ms = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--endgame") && i + 1 < argc) endgame = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--eval") && i + 1 < argc
+            && parse_evaluation(argv[i + 1], &evaluation)) i++;
+        else if (argv[i][0] != '-' && !filename) filename = argv[i];
+        else depth = move_ms = -1, i = argc;
+    }
+    if ((depth <= 0) == (move_ms <= 0) || depth < 0 || move_ms < 0) {
+        cerr << "usage: " << argv[0] << " --depth N | --time MS [--endgame N] [--threads N]"
+             << " [--eval squares|patterns|features] [file]" << endl;
+        exit(-1);
+    }
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+
+    ifstream file;
+    if (filename) {
+        file.open(filename);
+        if (!file) {
+            cerr << "cannot open " << filename << endl;
+            exit(-1);
+        }
+    }
+    istream& input = filename ? file : cin;
+
+    {
+        Player player(BLACK, 1);
+        if (!player.set_evaluation(evaluation)) {
+            cerr << "cannot load " << Player::pattern_file << endl;
+            exit(-1);
+        }
+    }
+
+    // Jobs [written, read) are in the window: claimed by a worker below
+    // next, waiting above it.
+    const int window = 4 * threads;
+    vector<Job> jobs(window);
+    long long read = 0, next = 0, written = 0;
+    bool input_done = false;
+    mutex lock;
+    condition_variable work_ready, job_done;
+
+    atomic<uint64_t> total_nodes(0);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread([&]() {
+            Player player(BLACK, 1);
+            player.set_evaluation(evaluation);
+            player.set_endgame_empties(endgame);
+            player.set_move_time(move_ms);
+
+            unique_lock<mutex> guard(lock);
+            while (true) {
+                work_ready.wait(guard, [&]() { return next < read || input_done; });
+                if (next == read) return;
+                Job& job = jobs[next++ % window];
+                guard.unlock();
+
+                if (job.valid) {
+                    if (popcount(job.board.empties()) <= endgame)
+                        job.result = player.solve(&job.board, job.side, -1);
+                    else
+                        job.result = player.search(&job.board, job.side,
+                            depth ? depth : Player::max_depth, -1);
+                    total_nodes += job.result.nodes;
+                }
+
+                guard.lock();
+                job.done = true;
+                job_done.notify_one();
+            }
+        }));
+    }
+
+    // Keep the window full and print finished jobs in order.
+    long long positions = 0;
+    int line_number = 0;
+    string line;
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        while (written < read && jobs[written % window].done) {
+            write_result(jobs[written % window]);
+            written++;
+        }
+        fflush(stdout);
+
+        if (!input_done && read - written < window) {
+            guard.unlock();
+            bool got_line = false;
+            while (getline(input, line)) {
+                line_number++;
+                if (!line.empty() && line[0] != '#'
+                    && line.find_first_not_of(" \t\r") != string::npos) {
+                    got_line = true;
+                    break;
+                }
+            }
+            guard.lock();
+            if (got_line) {
+                Job& job = jobs[read % window];
+                job.line_number = line_number;
+                job.valid = parse_position(line, &job);
+                job.done = false;
+                read++;
+                positions++;
+            } else {
+                input_done = true;
+                work_ready.notify_all();
+            }
+            work_ready.notify_one();
+            continue;
+        }
+        if (input_done && written == read) break;
+        job_done.wait(guard);
+    }
+    guard.unlock();
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "{\"total\": true, \"positions\": %lld, \"threads\": %d, \"seconds\": %.3f, "
+        "\"positions_per_second\": %.1f, \"nodes\": %llu, \"nps\": %.0f}\n",
+        positions, threads, seconds, positions / max(seconds, 1e-9),
+        (unsigned long long) total_nodes, total_nodes / max(seconds, 1e-9));
+    return 0;
+}
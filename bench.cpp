@@ -0,0 +1,127 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "player.hpp"
+using namespace std;
+
+// Runs every position of a benchmark suite (see bench_positions for the
+// format) and prints one JSON object per position, then one with the totals.
+// The suite's expected scores are for the square-weight evaluation; --eval
+// patterns or --eval features times another evaluation instead, and its
+// scores will differ. --mpc sets the Multi-ProbCut confidence (0 for off);
+// it only applies to an evaluation the ProbCut file was calibrated for.
+// --kernel picks a move generation kernel in place of the best one the CPU
+// supports; the totals name the one that ran.
+int main(int argc, char *argv[]) {
+    const char *filename = "bench_positions";
+    int threads = 1;
+    Evaluation evaluation = EVAL_SQUARES;
+    float mpc = Player::default_probcut_confidence;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--mpc") && i + 1 < argc) mpc = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--kernel") && i + 1 < argc) {
+            if (!Board::set_kernel(argv[++i])) {
+                cerr << "kernel " << argv[i] << " is unknown or not supported here" << endl;
+                exit(-1);
+            }
+        }
+        else if (!strcmp(argv[i], "--eval") && i + 1 < argc
+            && parse_evaluation(argv[i + 1], &evaluation)) i++;
+        else if (argv[i][0] != '-') filename = argv[i];
+        else {
+            cerr << "usage: " << argv[0] << " [suite] [--threads N] [--eval squares|patterns|features] [--mpc T]"
+                 << " [--kernel portable|bmi2|avx2]" << endl;
+            exit(-1);
+        }
+    }
+
+    ifstream input(filename);
+    if (!input) {
+        cerr << "cannot open " << filename << endl;
+        exit(-1);
+    }
+
+    Player player(BLACK, threads);
+    if (!player.set_evaluation(evaluation)) {
+        cerr << "cannot load " << Player::pattern_file << endl;
+        exit(-1);
+    }
+    player.set_probcut_confidence(mpc);
+    int positions = 0, move_matches = 0, score_matches = 0;
+    uint64_t total_nodes = 0, total_main_nodes = 0;
+    long long total_ms = 0;
+    string line;
+    while (getline(input, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        istringstream fields(line);
+        string board_str, side_str, depth_str, move_str;
+        int expected_score;
+        if (!(fields >> board_str >> side_str >> depth_str >> move_str >> expected_score)
+            || board_str.size() != 64) {
+            cerr << "bad line: " << line << endl;
+            exit(-1);
+        }
+
+        char data[64];
+        for (int i = 0; i < 64; i++)
+            data[i] = board_str[i] == '-' ? ' ' : board_str[i];
+        Board board;
+        board.setBoard(data);
+        char side = side_str[0] == WHITE ? WHITE : BLACK;
+        int x = -1, y = -1;
+        sscanf(move_str.c_str(), "%d,%d", &x, &y);
+        int expected_move = x < 0 ? -1 : SQUARE(x, y);
+
+        // Every position starts from an empty table.
+        player.new_game();
+        bool solve = depth_str == "solve";
+        SearchResult result = solve ? player.solve(&board, side, -1)
+            : player.search(&board, side, atoi(depth_str.c_str()), -1);
+
+        bool move_ok = result.best_move == expected_move;
+        bool score_ok = result.score == expected_score;
+        positions++;
+        move_matches += move_ok;
+        score_matches += score_ok;
+        total_nodes += result.nodes;
+
+        // The main thread's own nodes to reach the depth: with helpers on
+        // cores of their own, time to depth goes with this rather than with
+        // the nodes of all the threads.
+        uint64_t main_nodes = 0;
+        for (size_t i = 0; i < result.stats.iterations.size(); i++)
+            main_nodes += result.stats.iterations[i].counters.nodes;
+        if (solve) main_nodes = result.nodes;
+        total_main_nodes += main_nodes;
+        total_ms += result.ms;
+
+        printf("{\"position\": %d, \"empties\": %d, \"mode\": \"%s\", \"depth\": %d, "
+            "\"move\": \"%d,%d\", \"expected_move\": \"%s\", \"move_ok\": %s, "
+            "\"score\": %d, \"expected_score\": %d, \"score_ok\": %s, "
+            "\"nodes\": %llu, \"main_nodes\": %llu, \"ms\": %lld, \"nps\": %.0f}\n",
+            positions, popcount(board.empties()), solve ? "solve" : "search",
+            result.depth, result.best_move < 0 ? -1 : result.best_move % 8,
+            result.best_move < 0 ? -1 : result.best_move / 8, move_str.c_str(),
+            move_ok ? "true" : "false", result.score, expected_score,
+            score_ok ? "true" : "false", (unsigned long long) result.nodes,
+            (unsigned long long) main_nodes, result.ms,
+            result.nodes * 1000.0 / max(result.ms, 1LL));
+        fflush(stdout);
+    }
+
+    printf("{\"total\": true, \"positions\": %d, \"move_matches\": %d, "
+        "\"score_matches\": %d, \"nodes\": %llu, \"main_nodes\": %llu, \"ms\": %lld, "
+        "\"nps\": %.0f, \"threads\": %d, \"eval\": \"%s\", \"kernel\": \"%s\"}\n",
+        positions, move_matches, score_matches, (unsigned long long) total_nodes,
+        (unsigned long long) total_main_nodes, total_ms,
+        total_nodes * 1000.0 / max(total_ms, 1LL), threads,
+        evaluation_name(evaluation), Board::kernel_name());
+
+    return move_matches == positions && score_matches == positions ? 0 : 1;
+}
@@ -1,13 +1,348 @@
 #include "board.hpp"
+#include <algorithm>
+#include <immintrin.h>
+
+// Masks that drop discs shifted across the left or right edge of the board.
+static const uint64_t NOT_LEFT_EDGE  = 0xfefefefefefefefeULL;    // x != 0
+static const uint64_t NOT_RIGHT_EDGE = 0x7f7f7f7f7f7f7f7fULL;    // x != 7
+
+/*
+ * Zobrist keys are the splitmix64 stream from a fixed seed, generated at
+ * compile time so they are the same from run to run and valid before any
+ * static initializer runs.
+ */
+static constexpr uint64_t splitmix_finish(uint64_t z)
+{
+    return z ^ (z >> 31);
+}
+
+static constexpr uint64_t splitmix_middle(uint64_t z)
+{
+    return splitmix_finish((z ^ (z >> 27)) * 0x94d049bb133111ebULL);
+}
+
+static constexpr uint64_t splitmix64(uint64_t i)
+{
+    return splitmix_middle((0x9e3779b97f4a7c15ULL * (i + 2)
+        ^ (0x9e3779b97f4a7c15ULL * (i + 2) >> 30)) * 0xbf58476d1ce4e5b9ULL);
+}
+
+#define KEY(i)      splitmix64(i)
+#define KEY8(i)     KEY(i), KEY(i + 1), KEY(i + 2), KEY(i + 3), \
+                    KEY(i + 4), KEY(i + 5), KEY(i + 6), KEY(i + 7)
+#define KEY64(i)    KEY8(i), KEY8(i + 8), KEY8(i + 16), KEY8(i + 24), \
+                    KEY8(i + 32), KEY8(i + 40), KEY8(i + 48), KEY8(i + 56)
+#define FLIP(i)     (KEY(i) ^ KEY(i + 64))
+#define FLIP8(i)    FLIP(i), FLIP(i + 1), FLIP(i + 2), FLIP(i + 3), \
+                    FLIP(i + 4), FLIP(i + 5), FLIP(i + 6), FLIP(i + 7)
+
+const uint64_t zobrist_keys[2][64] = { { KEY64(0) }, { KEY64(64) } };
+const uint64_t zobrist_flip[64] = {
+    FLIP8(0), FLIP8(8), FLIP8(16), FLIP8(24),
+    FLIP8(32), FLIP8(40), FLIP8(48), FLIP8(56)
+};
+const uint64_t zobrist_white_to_move = KEY(128);
+
+/*
+ * Moves every disc in bits one square in the direction (dx, dy), dropping
+ * those that fall off the board.
+ */
+static inline uint64_t shift(uint64_t bits, int dx, int dy)
+{
+    int n = dx + 8 * dy;
+    bits = n > 0 ? bits << n : bits >> -n;
+    if(dx > 0)
+        bits &= NOT_LEFT_EDGE;
+    else if(dx < 0)
+        bits &= NOT_RIGHT_EDGE;
+    return bits;
+}
+
+/*
+ * Squares reached by a line of other's discs running from one of self's discs
+ * in the direction (dx, dy). A line is at most six discs long, so the fill is
+ * unrolled.
+ */
+static inline uint64_t moves_in_direction(uint64_t self, uint64_t other,
+    int dx, int dy)
+{
+    uint64_t line = shift(self, dx, dy) & other;
+    line |= shift(line, dx, dy) & other;
+    line |= shift(line, dx, dy) & other;
+    line |= shift(line, dx, dy) & other;
+    line |= shift(line, dx, dy) & other;
+    line |= shift(line, dx, dy) & other;
+    return shift(line, dx, dy);
+}
+
+/*
+ * Discs of other's that are flipped in the direction (dx, dy) when self plays
+ * the single square in move.
+ */
+static inline uint64_t flips_in_direction(uint64_t move, uint64_t self,
+    uint64_t other, int dx, int dy)
+{
+    uint64_t flips = 0;
+    uint64_t cursor = shift(move, dx, dy);
+    while(cursor & other)
+    {
+        flips |= cursor;
+        cursor = shift(cursor, dx, dy);
+    }
+    return (cursor & self) ? flips : 0;
+}
+
+/*
+ * Portable kernel: eight directions one after another with plain shifts.
+ */
+static uint64_t portable_find_moves(uint64_t self, uint64_t other)
+{
+    uint64_t moves = moves_in_direction(self, other, 1, 0)
+                   | moves_in_direction(self, other, -1, 0)
+                   | moves_in_direction(self, other, 0, 1)
+                   | moves_in_direction(self, other, 0, -1)
+                   | moves_in_direction(self, other, 1, 1)
+                   | moves_in_direction(self, other, -1, 1)
+                   | moves_in_direction(self, other, 1, -1)
+                   | moves_in_direction(self, other, -1, -1);
+    return moves & ~(self | other);
+}
+
+static uint64_t portable_find_flips(int square, uint64_t self, uint64_t other)
+{
+    uint64_t move = 1ULL << square;
+    return flips_in_direction(move, self, other, 1, 0)
+         | flips_in_direction(move, self, other, -1, 0)
+         | flips_in_direction(move, self, other, 0, 1)
+         | flips_in_direction(move, self, other, 0, -1)
+         | flips_in_direction(move, self, other, 1, 1)
+         | flips_in_direction(move, self, other, -1, 1)
+         | flips_in_direction(move, self, other, 1, -1)
+         | flips_in_direction(move, self, other, -1, -1);
+}
+
+/*
+ * BMI2 kernel. Each of the four lines through a square (row, column and the
+ * two diagonals) is gathered with PEXT into a byte, with the square at
+ * position p. outflank_table[p][inner discs of other] has the squares just
+ * past the runs of other's discs on each side of p; of those, self's are
+ * the outflanking discs, and flipped_table[p][outflanking] has the squares
+ * between them and p, which PDEP scatters back onto the board. Mobility
+ * uses the portable shifts.
+ */
+struct FlipLine
+{
+    uint64_t mask;
+    int position;
+};
+
+static FlipLine flip_lines[64][4];
+static uint8_t outflank_table[8][64];
+static uint8_t flipped_table[8][256];
+
+static void init_flip_tables()
+{
+    static const int directions[4][2] = { { 1, 0 }, { 0, 1 }, { 1, 1 }, { -1, 1 } };
+    for(int square = 0; square < 64; square++)
+    {
+        for(int d = 0; d < 4; d++)
+        {
+            uint64_t mask = 1ULL << square;
+            for(int sign = -1; sign <= 1; sign += 2)
+            {
+                int x = square % 8 + sign * directions[d][0];
+                int y = square / 8 + sign * directions[d][1];
+                for(; x >= 0 && x < 8 && y >= 0 && y < 8;
+                    x += sign * directions[d][0], y += sign * directions[d][1])
+                    mask |= 1ULL << SQUARE(x, y);
+            }
+            flip_lines[square][d].mask = mask;
+            flip_lines[square][d].position = popcount(mask & ((1ULL << square) - 1));
+        }
+    }
+
+    for(int p = 0; p < 8; p++)
+    {
+        for(int inner = 0; inner < 64; inner++)
+        {
+            int line = inner << 1;
+            int up = p + 1, down = p - 1;
+            while(up < 8 && (line >> up & 1))
+                up++;
+            while(down >= 0 && (line >> down & 1))
+                down--;
+            outflank_table[p][inner] = (up > p + 1 && up < 8 ? 1 << up : 0)
+                | (down < p - 1 && down >= 0 ? 1 << down : 0);
+        }
+        for(int outflank = 0; outflank < 256; outflank++)
+        {
+            int flipped = 0;
+            for(int q = 0; q < 8; q++)
+            {
+                if(!(outflank >> q & 1))
+                    continue;
+                for(int i = std::min(p, q) + 1; i < std::max(p, q); i++)
+                    flipped |= 1 << i;
+            }
+            flipped_table[p][outflank] = flipped;
+        }
+    }
+}
+
+__attribute__((target("bmi2")))
+static uint64_t bmi2_find_flips(int square, uint64_t self, uint64_t other)
+{
+    uint64_t flips = 0;
+    for(int d = 0; d < 4; d++)
+    {
+        const FlipLine& line = flip_lines[square][d];
+        unsigned outflank = outflank_table[line.position][_pext_u64(other, line.mask) >> 1 & 0x3f]
+            & _pext_u64(self, line.mask);
+        flips |= _pdep_u64(flipped_table[line.position][outflank], line.mask);
+    }
+    return flips;
+}
+
+/*
+ * AVX2 kernel: the four directions towards higher squares (shifts of 1, 8,
+ * 9 and 7) fill in the four lanes of one vector, and the four opposite ones
+ * in another. Other's discs on the left and right edges are masked out for
+ * the directions with a sideways step, so no run wraps round a row.
+ */
+__attribute__((target("avx2")))
+static inline __m256i avx2_shifts()
+{
+    return _mm256_set_epi64x(7, 9, 8, 1);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_runs_of(uint64_t other)
+{
+    const long long inner = (long long) 0x7e7e7e7e7e7e7e7eULL;
+    return _mm256_and_si256(_mm256_set1_epi64x(other),
+        _mm256_set_epi64x(inner, inner, -1LL, inner));
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t avx2_or_lanes(__m256i bits)
+{
+    __m128i half = _mm_or_si128(_mm256_castsi256_si128(bits),
+        _mm256_extracti128_si256(bits, 1));
+    return _mm_cvtsi128_si64(half) | _mm_extract_epi64(half, 1);
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_find_moves(uint64_t self, uint64_t other)
+{
+    __m256i shifts = avx2_shifts();
+    __m256i runs = avx2_runs_of(other);
+    __m256i discs = _mm256_set1_epi64x(self);
+    __m256i up = _mm256_and_si256(runs, _mm256_sllv_epi64(discs, shifts));
+    __m256i down = _mm256_and_si256(runs, _mm256_srlv_epi64(discs, shifts));
+    for(int i = 0; i < 5; i++)
+    {
+        up = _mm256_or_si256(up, _mm256_and_si256(runs, _mm256_sllv_epi64(up, shifts)));
+        down = _mm256_or_si256(down, _mm256_and_si256(runs, _mm256_srlv_epi64(down, shifts)));
+    }
+    __m256i moves = _mm256_or_si256(_mm256_sllv_epi64(up, shifts),
+        _mm256_srlv_epi64(down, shifts));
+    return avx2_or_lanes(moves) & ~(self | other);
+}
+
+__attribute__((target("avx2")))
+static uint64_t avx2_find_flips(int square, uint64_t self, uint64_t other)
+{
+    __m256i shifts = avx2_shifts();
+    __m256i runs = avx2_runs_of(other);
+    __m256i discs = _mm256_set1_epi64x(self);
+    __m256i move = _mm256_set1_epi64x(1LL << square);
+    __m256i up = _mm256_and_si256(runs, _mm256_sllv_epi64(move, shifts));
+    __m256i down = _mm256_and_si256(runs, _mm256_srlv_epi64(move, shifts));
+    for(int i = 0; i < 5; i++)
+    {
+        up = _mm256_or_si256(up, _mm256_and_si256(runs, _mm256_sllv_epi64(up, shifts)));
+        down = _mm256_or_si256(down, _mm256_and_si256(runs, _mm256_srlv_epi64(down, shifts)));
+    }
+
+    // A run is flipped if the square just past it is self's.
+    __m256i zero = _mm256_setzero_si256();
+    __m256i up_open = _mm256_cmpeq_epi64(
+        _mm256_and_si256(_mm256_sllv_epi64(up, shifts), discs), zero);
+    __m256i down_open = _mm256_cmpeq_epi64(
+        _mm256_and_si256(_mm256_srlv_epi64(down, shifts), discs), zero);
+    return avx2_or_lanes(_mm256_or_si256(_mm256_andnot_si256(up_open, up),
+        _mm256_andnot_si256(down_open, down)));
+}
+
+/*
+ * The kernels, slowest first. At startup move_kernel becomes the last one
+ * the CPU supports; until then, and in any static initializer that runs
+ * earlier, it is the portable one.
+ */
+static const MoveKernel kernels[] = {
+    { "portable", portable_find_moves, portable_find_flips },
+    { "bmi2", portable_find_moves, bmi2_find_flips },
+    { "avx2", avx2_find_moves, avx2_find_flips }
+};
+static const int num_kernels = sizeof(kernels) / sizeof(kernels[0]);
+
+MoveKernel move_kernel = { "portable", portable_find_moves, portable_find_flips };
+
+static bool kernel_supported(const MoveKernel& kernel)
+{
+    __builtin_cpu_init();
+    if(!strcmp(kernel.name, "bmi2"))
+        return __builtin_cpu_supports("bmi2");
+    if(!strcmp(kernel.name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    return true;
+}
+
+static bool select_best_kernel()
+{
+    for(int i = num_kernels - 1; i > 0; i--)
+        if(Board::set_kernel(kernels[i].name))
+            return true;
+    return false;
+}
+
+static bool best_kernel_selected = select_best_kernel();
+
+/*
+ * Name of the move generation kernel in use.
+ */
+const char* Board::kernel_name()
+{
+    return move_kernel.name;
+}
+
+/*
+ * Switches to the named kernel. Returns false, leaving the kernel as it
+ * was, if there is none by that name or the CPU does not support it. Must
+ * not be called while another thread is generating moves.
+ */
+bool Board::set_kernel(const char* name)
+{
+    for(int i = 0; i < num_kernels; i++)
+    {
+        if(strcmp(kernels[i].name, name) || !kernel_supported(kernels[i]))
+            continue;
+        if(kernels[i].find_flips == bmi2_find_flips)
+            init_flip_tables();
+        move_kernel = kernels[i];
+        return true;
+    }
+    return false;
+}
 
 /*
  * Make a standard 8x8 othello board and initialize it to the standard setup.
  */
 Board::Board()
-    : data()
+    : black(0),
+      white(0),
+      key(0)
 {
-    for(int i = 0; i < 64; i++)
-        data[i] = ' ';
     set(WHITE, 3, 3);
     set(WHITE, 4, 4);
     set(BLACK, 3, 4);
@@ -17,8 +352,7 @@ Board::Board()
 Board::Board(char data_in[])
     : Board()
 {
-    for(int i = 0; i < 64; i++)
-        data[i] = data_in[i];
+    setBoard(data_in);
 }
 
 /*
@@ -34,17 +368,39 @@ bool Board::onBoard(int x, int y)
 
 bool Board::get(char side, int x, int y)
 {
-    return data[x+8*y] == side;
+    uint64_t bit = 1ULL << SQUARE(x, y);
+    if(side == BLACK)
+        return black & bit;
+    if(side == WHITE)
+        return white & bit;
+    return !((black | white) & bit);
 }
 
 void Board::set(char side, int x, int y)
 {
-    data[x+8*y] = side;
+    int square = SQUARE(x, y);
+    uint64_t bit = 1ULL << square;
+    if(black & bit)
+        key ^= zobrist_keys[0][square];
+    if(white & bit)
+        key ^= zobrist_keys[1][square];
+    black &= ~bit;
+    white &= ~bit;
+    if(side == BLACK)
+    {
+        black |= bit;
+        key ^= zobrist_keys[0][square];
+    }
+    else if(side == WHITE)
+    {
+        white |= bit;
+        key ^= zobrist_keys[1][square];
+    }
 }
 
 bool Board::occupied(int x, int y)
 {
-    return data[x+8*y] != ' ';
+    return (black | white) & (1ULL << SQUARE(x, y));
 }
 
 /*
@@ -60,13 +416,15 @@ bool Board::isDone() {
  */
 bool Board::hasMoves(char side)
 {
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            Move move(i, j);
-            if (checkMove(&move, side)) return true;
-        }
-    }
-    return false;
+    return getMoves(side) != 0;
+}
+
+/*
+ * Returns the squares where the given side can legally play, one bit each.
+ */
+uint64_t Board::getMoves(char side)
+{
+    return find_moves(pieces(side), pieces(OTHER_SIDE(side)));
 }
 
 /*
@@ -77,31 +435,11 @@ bool Board::checkMove(Move *m, char side)
     // Passing is only legal if you have no moves.
     if (m == nullptr) return !hasMoves(side);
 
-    int X = m->get_x();
-    int Y = m->get_y();
-
     // Make sure the square hasn't already been taken.
-    if (occupied(X, Y)) return false;
-
-    char other = OTHER_SIDE(side);
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if (dy == 0 && dx == 0) continue;
-
-            // Is there a capture in that direction?
-            int x = X + dx;
-            int y = Y + dy;
-            if (0 <= x && x <= 7 && 0 <= y && y <= 7 && get(other, x, y)) {
-                do {
-                    x += dx;
-                    y += dy;
-                } while (0 <= x && x <= 7 && 0 <= y && y <= 7 && get(other, x, y));
-
-                if (0 <= x && x <= 7 && 0 <= y && y <= 7 && get(side, x, y)) return true;
-            }
-        }
-    }
-    return false;
+    if (occupied(m->x, m->y)) return false;
+
+    return find_flips(SQUARE(m->x, m->y), pieces(side),
+        pieces(OTHER_SIDE(side))) != 0;
 }
 
 /*
@@ -112,37 +450,53 @@ void Board::doMove(Move *m, char side) {
     if (m == nullptr) return;
 
     // Ignore if move is invalid.
-    if (!checkMove(m, side)) return;
-
-    int X = m->get_x();
-    int Y = m->get_y();
-    char other = OTHER_SIDE(side);
-
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if (dy == 0 && dx == 0) continue;
-
-            int x = X;
-            int y = Y;
-            do {
-                x += dx;
-                y += dy;
-            } while (0 <= x && x <= 7 && 0 <= y && y <= 7 && get(other, x, y));
-
-            if (onBoard(x, y) && get(side, x, y)) {
-                x = X;
-                y = Y;
-                x += dx;
-                y += dy;
-                while (onBoard(x, y) && get(other, x, y)) {
-                    set(side, x, y);
-                    x += dx;
-                    y += dy;
-                }
-            }
-        }
-    }
-    set(side, X, Y);
+    if (occupied(m->x, m->y)) return;
+
+    int square = SQUARE(m->x, m->y);
+    if (!find_flips(square, pieces(side), pieces(OTHER_SIDE(side)))) return;
+
+    UndoRecord undo;
+    makeMove(square, side, &undo);
+}
+
+/*
+ * Plays side's disc on square without checking that the move is legal, which
+ * the caller guarantees by taking it from getMoves(). Records what changed in
+ * undo so unmakeMove() can take it back, and updates the hash key as it goes.
+ */
+void Board::makeMove(int square, char side, UndoRecord* undo)
+{
+    uint64_t& self = side == BLACK ? black : white;
+    uint64_t& other = side == BLACK ? white : black;
+    uint64_t flips = find_flips(square, self, other);
+
+    undo->flips = flips;
+    undo->square = square;
+    undo->side = side;
+
+    self |= flips | (1ULL << square);
+    other &= ~flips;
+
+    key ^= zobrist_keys[side == WHITE][square];
+    while(flips)
+        key ^= zobrist_flip[pop_square(flips)];
+}
+
+/*
+ * Restores the position from before the makeMove() that filled undo. Moves
+ * must be taken back in the reverse order they were made.
+ */
+void Board::unmakeMove(const UndoRecord& undo)
+{
+    uint64_t& self = undo.side == BLACK ? black : white;
+    uint64_t& other = undo.side == BLACK ? white : black;
+
+    self &= ~(undo.flips | (1ULL << undo.square));
+    other |= undo.flips;
+
+    key ^= zobrist_keys[undo.side == WHITE][undo.square];
+    for(uint64_t flips = undo.flips; flips; )
+        key ^= zobrist_flip[pop_square(flips)];
 }
 
 /*
@@ -150,37 +504,41 @@ void Board::doMove(Move *m, char side) {
  */
 int Board::count(char side)
 {
-    int total = 0;
-    for(int i = 0; i < 64; i++)
-        total += data[i] == side;
-    return total;
+    return popcount(pieces(side));
 }
 
 void Board::setBoard(char data[])
 {
+    black = 0;
+    white = 0;
+    key = 0;
     for(int i = 0; i < 64; i++)
-        this->data[i] = data[i];
-}
-
-void rotate_data(char data_in[64], char rotated[64])
-{
-    for(int x = 0; x < 8; x++)
     {
-        for(int y = 0; y < 8; y++)
+        if(data[i] == BLACK)
+        {
+            black |= 1ULL << i;
+            key ^= zobrist_keys[0][i];
+        }
+        else if(data[i] == WHITE)
         {
-            rotated[x+8*y] = data_in[(y+8*(7-x))];
+            white |= 1ULL << i;
+            key ^= zobrist_keys[1][i];
         }
     }
 }
 
-Move rotate_move(Move move_in, int rotations)
+/*
+ * Writes the board out in the 64-character format used by the opening book.
+ */
+void Board::getData(char data_out[64])
 {
-    Move rotated = move_in;
-    for(int i = 0; i < rotations; i++)
+    for(int i = 0; i < 64; i++)
     {
-        Move temp(7 - rotated.y, rotated.x);
-        rotated = temp;
+        if(black & (1ULL << i))
+            data_out[i] = BLACK;
+        else if(white & (1ULL << i))
+            data_out[i] = WHITE;
+        else
+            data_out[i] = ' ';
     }
-    return rotated;
 }
-
@@ -1,19 +1,143 @@
 #ifndef __BOARD_H__
 #define __BOARD_H__
 
+#include <stdint.h>
 #include <string.h>
 #include "common.hpp"
 using namespace std;
 
+/*
+ * Bit index of square (x, y). Bit 0 is the top-left corner and bit 63 the
+ * bottom-right one, the same order as the 64-character board strings used by
+ * the opening book.
+ */
+#define SQUARE(x, y)    ((x) + 8 * (y))
+
+static inline int popcount(uint64_t bits)
+{
+    return __builtin_popcountll(bits);
+}
+
+/*
+ * Removes the lowest set bit from bits and returns its square index. Used to
+ * walk a move mask without building a list.
+ */
+static inline int pop_square(uint64_t& bits)
+{
+    int square = __builtin_ctzll(bits);
+    bits &= bits - 1;
+    return square;
+}
+
+/*
+ * Symmetries of the board. Each maps a bitboard to its image: mirror_board
+ * flips x, flip_board flips y, and transpose_board swaps x and y.
+ */
+static inline uint64_t mirror_board(uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    return x;
+}
+
+static inline uint64_t flip_board(uint64_t x)
+{
+    return __builtin_bswap64(x);
+}
+
+static inline uint64_t transpose_board(uint64_t x)
+{
+    uint64_t t;
+    t = 0x0f0f0f0f00000000ULL & (x ^ (x << 28));
+    x ^= t ^ (t >> 28);
+    t = 0x3333000033330000ULL & (x ^ (x << 14));
+    x ^= t ^ (t >> 14);
+    t = 0x5500550055005500ULL & (x ^ (x << 7));
+    x ^= t ^ (t >> 7);
+    return x;
+}
+
+/*
+ * The eight symmetries by number: bit 0 mirrors, bit 1 flips, bit 2
+ * transposes first. Every symmetry is its own inverse except 5 and 6, which
+ * are quarter turns in opposite directions.
+ */
+static inline uint64_t symmetry(uint64_t bits, int which)
+{
+    if(which & 4)
+        bits = transpose_board(bits);
+    if(which & 2)
+        bits = flip_board(bits);
+    if(which & 1)
+        bits = mirror_board(bits);
+    return bits;
+}
+
+static inline int inverse_symmetry(int which)
+{
+    return which == 5 ? 6 : which == 6 ? 5 : which;
+}
+
+// Random keys for Zobrist hashing: one per (side, square), plus one that is
+// mixed in when white is to move. zobrist_flip[i] is the change in the key
+// when the disc on square i changes colour.
+extern const uint64_t zobrist_keys[2][64];
+extern const uint64_t zobrist_flip[64];
+extern const uint64_t zobrist_white_to_move;
+
+/*
+ * A move generation kernel: one implementation of find_moves() and
+ * find_flips(). Several are compiled for different instruction sets, and
+ * the best one the CPU supports is chosen at startup; see board.cpp.
+ */
+struct MoveKernel
+{
+    const char* name;
+    uint64_t (*find_moves)(uint64_t self, uint64_t other);
+    uint64_t (*find_flips)(int square, uint64_t self, uint64_t other);
+};
+
+extern MoveKernel move_kernel;
+
+// Squares where self can legally play against other.
+static inline uint64_t find_moves(uint64_t self, uint64_t other)
+{
+    return move_kernel.find_moves(self, other);
+}
+
+// Discs of other's flipped if self plays on square; empty if the move is
+// not legal. Occupancy of square itself is not checked.
+static inline uint64_t find_flips(int square, uint64_t self, uint64_t other)
+{
+    return move_kernel.find_flips(square, self, other);
+}
+
+/*
+ * Everything makeMove() changed, so that unmakeMove() can restore it.
+ */
+struct UndoRecord
+{
+    uint64_t flips;
+    int square;
+    char side;
+};
+
 class Board {
 
 public:
-    char data[64];
+    // One bit per square for each side, indexed by SQUARE(x, y).
+    uint64_t black;
+    uint64_t white;
+    uint64_t key;   // Zobrist key of the discs, kept up to date by every change
 
     bool occupied(int x, int y);
     bool get(char side, int x, int y);
     void set(char side, int x, int y);
 
+    uint64_t pieces(char side) const { return side == BLACK ? black : white; }
+    uint64_t empties() const { return ~(black | white); }
+
     Board();
     Board(char data_in[64]);
     ~Board();
@@ -21,20 +145,32 @@ public:
     bool onBoard(int x, int y);
     bool isDone();
     bool hasMoves(char side);
+    uint64_t getMoves(char side);
     bool checkMove(Move *m, char side);
     void doMove(Move *m, char side);
+    void makeMove(int square, char side, UndoRecord* undo);
+    void unmakeMove(const UndoRecord& undo);
     int count(char side);
     void setBoard(char data[]);
+    void getData(char data_out[64]);
+
+    static const char* kernel_name();
+    static bool set_kernel(const char* name);
+
+    // Zobrist hash of the position with the given side to move. Inline so
+    // that a search compiled for one side folds the test away.
+    uint64_t hash(char side_to_move) const
+    {
+        return side_to_move == WHITE ? key ^ zobrist_white_to_move : key;
+    }
 };
 
-void rotate_data(char data_in[64], char rotated[64]);
-Move rotate_move(Move move_in, int rotations);
 
 struct BoardCmp
 {
     bool operator()(const Board& a, const Board& b)
     {
-        return memcmp(a.data, b.data, 64) < 0;
+        return a.black < b.black || (a.black == b.black && a.white < b.white);
     }
 };
 
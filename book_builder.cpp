@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "opening_book.hpp"
+#include "player.hpp"
+using namespace std;
+
+// Builds an opening book offline.
+//
+// The opening tree is expanded from the start position, either full-width or
+// along the games in a record file, to a fixed number of plies. Its leaves
+// are scored by deep searches on all cores, the scores are negamaxed back up
+// the tree, and every position in the tree where there is a move to make
+// becomes a book entry with its best move and score (in discs).
+//
+// Each leaf score is appended to a checkpoint file as soon as it is known.
+// Run again with the same checkpoint and settings and the leaves already
+// scored are not searched again, so an interrupted build loses at most the
+// searches that were running.
+//
+// Game records have one game per line as coordinates, e.g. "f5d6c3d3c4";
+// anything that is not a letter a-h followed by a digit 1-8 is skipped.
+
+typedef pair<uint64_t, uint64_t> Position;   // Side to move, opponent
+
+struct TreeNode {
+    int ply;
+    bool leaf;          // Scored by search rather than from its children
+    bool visited;       // Set while negamaxing
+    bool scored;        // score is known: searched, or from a scored child
+    int score;          // Evaluation units, side to move
+    int best_move;      // Canonical square, or -1
+};
+
+static map<Position, TreeNode> tree;
+static int book_plies = 8;
+static int search_depth = 12;
+static int num_threads = 0;
+
+static Position canonical(uint64_t self, uint64_t other) {
+    OpeningBook::canonicalize(&self, &other);
+    return make_pair(self, other);
+}
+
+static Position play(Position pos, int square) {
+    uint64_t flips = find_flips(square, pos.first, pos.second);
+    return make_pair(pos.second ^ flips, pos.first | flips | (1ULL << square));
+}
+
+/*
+ * Adds pos and, if it is shallower than book_plies, every position after it
+ * to the tree. A pass takes up a ply, as it does in perft.
+ */
+static void expand(Position pos, int ply) {
+    Position key = canonical(pos.first, pos.second);
+    map<Position, TreeNode>::iterator it = tree.find(key);
+    if (it != tree.end() && it->second.ply <= ply) return;
+
+    TreeNode node = { ply, ply >= book_plies, false, false, 0, -1 };
+    tree[key] = node;
+    if (node.leaf) return;
+
+    uint64_t moves = find_moves(key.first, key.second);
+    if (!moves) {
+        if (find_moves(key.second, key.first)) expand(make_pair(key.second, key.first), ply + 1);
+        return;
+    }
+    while (moves) expand(play(key, pop_square(moves)), ply + 1);
+}
+
+/*
+ * Adds pos to the tree as an interior node, one the game goes on from.
+ */
+static void add_interior(Position pos, int ply) {
+    Position key = canonical(pos.first, pos.second);
+    map<Position, TreeNode>::iterator it = tree.find(key);
+    if (it == tree.end()) {
+        TreeNode node = { ply, false, false, false, 0, -1 };
+        tree[key] = node;
+    } else {
+        it->second.leaf = false;
+        it->second.ply = min(it->second.ply, ply);
+    }
+}
+
+/*
+ * Adds the positions along one game record, up to book_plies. The record
+ * ends in a leaf wherever it stops: at book_plies, at its last move, or
+ * before a move that is not legal. A pass, written or not, takes up a ply.
+ */
+static void expand_game(const string& record) {
+    Position pos = make_pair(Board().black, Board().white);
+    int ply = 0;
+    for (size_t i = 0; i + 1 < record.size() && ply < book_plies; i++) {
+        char file = tolower(record[i]), rank = record[i + 1];
+        if (file < 'a' || file > 'h' || rank < '1' || rank > '8') continue;
+        int square = SQUARE(file - 'a', rank - '1');
+        i++;
+
+        if (!find_moves(pos.first, pos.second) && find_moves(pos.second, pos.first)) {
+            add_interior(pos, ply);
+            pos = make_pair(pos.second, pos.first);
+            ply++;
+            if (ply >= book_plies) break;
+        }
+        if (!(find_moves(pos.first, pos.second) >> square & 1)) break;
+        add_interior(pos, ply);
+        pos = play(pos, square);
+        ply++;
+    }
+
+    Position key = canonical(pos.first, pos.second);
+    if (!tree.count(key)) {
+        TreeNode node = { ply, true, false, false, 0, -1 };
+        tree[key] = node;
+    }
+}
+
+/*
+ * Reads the leaf scores saved by earlier runs.
+ */
+static int read_checkpoint(const char* filename) {
+    ifstream input(filename);
+    int restored = 0;
+    unsigned long long self, other;
+    int score;
+    string line;
+    while (getline(input, line)) {
+        if (sscanf(line.c_str(), "%llx %llx %d", &self, &other, &score) != 3) continue;
+        map<Position, TreeNode>::iterator it = tree.find(make_pair(self, other));
+        if (it != tree.end() && it->second.leaf) {
+            it->second.visited = true;
+            it->second.scored = true;
+            it->second.score = score;
+            restored++;
+        }
+    }
+    return restored;
+}
+
+/*
+ * Searches every leaf that has no score yet, one per thread at a time, and
+ * appends each score to the checkpoint file as it comes in.
+ */
+static bool score_leaves(const char* checkpoint) {
+    vector<map<Position, TreeNode>::iterator> work;
+    for (map<Position, TreeNode>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        if (it->second.leaf && !it->second.visited) {
+            uint64_t self = it->first.first, other = it->first.second;
+            if (!find_moves(self, other) && !find_moves(other, self)) {
+                // Game over: the score is exact.
+                it->second.score = (popcount(self) - popcount(other)) * PatternEvaluator::disc_scale;
+                it->second.visited = true;
+                it->second.scored = true;
+            } else {
+                work.push_back(it);
+            }
+        }
+    }
+
+    ofstream out(checkpoint, ios::app);
+    if (!out) {
+        cerr << "cannot open " << checkpoint << endl;
+        return false;
+    }
+
+    atomic<size_t> next(0);
+    mutex out_lock;
+    bool ok = true;
+    vector<thread> workers;
+    for (int t = 0; t < num_threads; t++) {
+        workers.push_back(thread([&]() {
+            Player player(BLACK, 1);
+            if (!player.set_evaluation(EVAL_PATTERNS)) {
+                lock_guard<mutex> lock(out_lock);
+                ok = false;
+                return;
+            }
+            for (size_t i = next++; i < work.size(); i = next++) {
+                char data[64];
+                for (int square = 0; square < 64; square++)
+                    data[square] = work[i]->first.first >> square & 1 ? BLACK
+                        : work[i]->first.second >> square & 1 ? WHITE : ' ';
+                Board board;
+                board.setBoard(data);
+                SearchResult result = player.search(&board, BLACK, search_depth, -1);
+
+                lock_guard<mutex> lock(out_lock);
+                work[i]->second.score = result.score;
+                work[i]->second.visited = true;
+                work[i]->second.scored = true;
+                out << hex << work[i]->first.first << " " << work[i]->first.second
+                    << dec << " " << result.score << endl;
+                if ((i + 1) % 10 == 0 || i + 1 == work.size())
+                    fprintf(stderr, "scored %zu of %zu leaves\n", i + 1, work.size());
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    if (!ok) cerr << "cannot load " << Player::pattern_file << endl;
+    return ok;
+}
+
+/*
+ * Negamax over the tree: a node's score is the best of its scored
+ * children's, negated, and it has none if none of them has one. Passes hand
+ * the move over without changing the board. Returns whether the node has a
+ * score.
+ */
+static bool negamax(const Position& key) {
+    TreeNode& node = tree[key];
+    if (node.leaf || node.visited) return node.scored;
+    node.visited = true;
+
+    uint64_t moves = find_moves(key.first, key.second);
+    if (!moves) {
+        if (!find_moves(key.second, key.first)) {
+            node.score = (popcount(key.first) - popcount(key.second)) * PatternEvaluator::disc_scale;
+            node.scored = true;
+            return true;
+        }
+        Position passed = canonical(key.second, key.first);
+        if (tree.count(passed) && negamax(passed)) {
+            node.score = -tree[passed].score;
+            node.scored = true;
+        }
+        return node.scored;
+    }
+
+    while (moves) {
+        int square = pop_square(moves);
+        Position next = play(key, square);
+        Position child = canonical(next.first, next.second);
+        if (!tree.count(child) || !negamax(child)) continue;
+        int score = -tree[child].score;
+        if (!node.scored || score > node.score) {
+            node.score = score;
+            node.best_move = square;
+            node.scored = true;
+        }
+    }
+    return node.scored;
+}
+
+int main(int argc, char *argv[]) {
+    const char *games = nullptr, *checkpoint = nullptr, *out_file = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--plies") && i + 1 < argc) book_plies = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--depth") && i + 1 < argc) search_depth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) num_threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--games") && i + 1 < argc) games = argv[++i];
+        else if (!strcmp(argv[i], "--checkpoint") && i + 1 < argc) checkpoint = argv[++i];
+        else if (argv[i][0] != '-' && !out_file) out_file = argv[i];
+        else out_file = nullptr, i = argc;
+    }
+    if (!out_file || book_plies < 1 || search_depth < 1) {
+        cerr << "usage: " << argv[0] << " [--plies N] [--depth N] [--threads N]"
+             << " [--games FILE] [--checkpoint FILE] book_file" << endl;
+        exit(-1);
+    }
+    if (num_threads <= 0) num_threads = max(1u, thread::hardware_concurrency());
+    string checkpoint_file = checkpoint ? checkpoint : string(out_file) + ".checkpoint";
+
+    if (games) {
+        ifstream input(games);
+        if (!input) {
+            cerr << "cannot open " << games << endl;
+            exit(-1);
+        }
+        string record;
+        while (getline(input, record)) expand_game(record);
+    } else {
+        Board start;
+        expand(make_pair(start.black, start.white), 0);
+    }
+
+    size_t leaves = 0;
+    for (map<Position, TreeNode>::iterator it = tree.begin(); it != tree.end(); ++it)
+        leaves += it->second.leaf;
+    int restored = read_checkpoint(checkpoint_file.c_str());
+    fprintf(stderr, "%zu positions, %zu leaves, %d scored by an earlier run\n",
+        tree.size(), leaves, restored);
+
+    if (!score_leaves(checkpoint_file.c_str())) return 1;
+
+    // Leaves are done; clear the marks on the interior so negamax visits it.
+    for (map<Position, TreeNode>::iterator it = tree.begin(); it != tree.end(); ++it)
+        if (!it->second.leaf) it->second.visited = false;
+    Board start;
+    negamax(canonical(start.black, start.white));
+
+    vector<BookEntry> entries;
+    for (map<Position, TreeNode>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        const TreeNode& node = it->second;
+        if (node.leaf || node.best_move < 0 || !node.visited) continue;
+        BookEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.self = it->first.first;
+        entry.other = it->first.second;
+        entry.move = node.best_move;
+        int discs = node.score / PatternEvaluator::disc_scale;
+        entry.score = max(-64, min(64, discs));
+        entry.depth = min(255, search_depth + book_plies - node.ply);
+        entries.push_back(entry);
+    }
+
+    if (!OpeningBook::write(out_file, entries)) {
+        cerr << "cannot write " << out_file << endl;
+        return 1;
+    }
+    fprintf(stderr, "wrote %zu positions to %s\n", entries.size(), out_file);
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "board.hpp"
+#include "opening_book.hpp"
+using namespace std;
+
+// Converts a text opening book (presbyterian_ghostbusters_moves: each entry
+// is eight lines of eight characters, 'b', 'w' or ' ', then "x,y") into the
+// binary format OpeningBook maps, or dumps a binary book back as text.
+//
+// The text format does not say whose move it is. That is taken from the
+// parity of the disc count, unless the move is only legal for the other side
+// (after a pass); entries whose move is legal for neither are dropped.
+
+static int convert(const char *text_file, const char *book_file) {
+    ifstream input(text_file);
+    if (!input) {
+        cerr << "cannot open " << text_file << endl;
+        return 1;
+    }
+
+    vector<BookEntry> entries;
+    int read = 0, dropped = 0;
+    string line;
+    while (true) {
+        char data[64];
+        int row = 0;
+        while (row < 8 && getline(input, line)) {
+            line.resize(8, ' ');
+            memcpy(data + 8 * row++, line.data(), 8);
+        }
+        int x, y;
+        if (row < 8 || !getline(input, line) || sscanf(line.c_str(), "%d,%d", &x, &y) != 2)
+            break;
+        read++;
+
+        Board board;
+        board.setBoard(data);
+        Move move(x, y);
+        char side = popcount(board.black | board.white) % 2 == 0 ? BLACK : WHITE;
+        if (!board.checkMove(&move, side)) side = OTHER_SIDE(side);
+        if (x < 0 || x > 7 || y < 0 || y > 7 || !board.checkMove(&move, side)) {
+            cerr << "dropping entry " << read << ": " << x << "," << y
+                 << " is not a legal move" << endl;
+            dropped++;
+            continue;
+        }
+
+        BookEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.self = board.pieces(side);
+        entry.other = board.pieces(OTHER_SIDE(side));
+        int which = OpeningBook::canonicalize(&entry.self, &entry.other);
+        entry.move = __builtin_ctzll(symmetry(1ULL << SQUARE(x, y), which));
+        entries.push_back(entry);
+    }
+
+    if (!OpeningBook::write(book_file, entries)) {
+        cerr << "cannot write " << book_file << endl;
+        return 1;
+    }
+    OpeningBook book(book_file);
+    fprintf(stderr, "%d entries read, %d dropped, %llu positions written\n",
+        read, dropped, (unsigned long long) book.size());
+    return 0;
+}
+
+static int dump(const char *book_file) {
+    OpeningBook book(book_file);
+    vector<BookEntry> entries;
+    book.entries(&entries);
+    if (entries.empty()) {
+        cerr << "no positions in " << book_file << endl;
+        return 1;
+    }
+
+    // The side to move gets the colour the parity rule will read back.
+    for (size_t i = 0; i < entries.size(); i++) {
+        uint64_t self = entries[i].self, other = entries[i].other;
+        char self_colour = popcount(self | other) % 2 == 0 ? BLACK : WHITE;
+        char data[64];
+        for (int j = 0; j < 64; j++)
+            data[j] = (self >> j & 1) ? self_colour : (other >> j & 1) ? OTHER_SIDE(self_colour) : ' ';
+        print_board(data, cout);
+        cout << entries[i].move % 8 << "," << entries[i].move / 8 << "\n";
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && !strcmp(argv[1], "--dump")) return dump(argv[2]);
+    if (argc == 3) return convert(argv[1], argv[2]);
+
+    cerr << "usage: " << argv[0] << " text_book book_file" << endl
+         << "       " << argv[0] << " --dump book_file" << endl;
+    return -1;
+}
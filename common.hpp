@@ -1,12 +1,15 @@
 #pragma once
 
+#include <limits>
+
 static const char WHITE = 'w';
 static const char BLACK = 'b';
 
 #define OTHER_SIDE(side)    \
     (side == WHITE ? BLACK : WHITE)
 
-#define INFINITY std::numeric_limits<int>::max()
+// Bound on search scores. Not INFINITY, which <cmath> defines as a macro.
+static constexpr int SCORE_INFINITY = std::numeric_limits<int>::max();
 
 class Move {
    
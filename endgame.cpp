@@ -0,0 +1,407 @@
+#include "endgame.hpp"
+
+// Positions with at least this many empties are cached in the transposition
+// table and ordered fastest-first. Below that, ordering is by parity alone.
+static const int MIN_EMPTIES_FOR_TT = 10;
+static const int MIN_EMPTIES_FOR_FASTEST_FIRST = 7;
+
+// Lower than any real score, used before a move has been searched.
+static const int NO_SCORE = -EndgameSolver::max_score - 1;
+
+static const uint64_t QUADRANTS[4] = {
+    0x000000000f0f0f0fULL, 0x00000000f0f0f0f0ULL,
+    0x0f0f0f0f00000000ULL, 0xf0f0f0f000000000ULL
+};
+
+static const uint64_t CORNERS = 0x8100000000000081ULL;
+
+/*
+ * Score of a finished game for self, with the empty squares going to the
+ * winner.
+ */
+static inline int final_score(uint64_t self, uint64_t other)
+{
+    int diff = popcount(self) - popcount(other);
+    int empties = 64 - popcount(self | other);
+    if(diff > 0)
+        return diff + empties;
+    if(diff < 0)
+        return diff - empties;
+    return 0;
+}
+
+/*
+ * Empty squares lying in quadrants with an odd number of empties. Playing
+ * there first tends to leave the last move in each region to the mover.
+ */
+static inline uint64_t odd_quadrants(uint64_t empties)
+{
+    uint64_t odd = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        if(popcount(empties & QUADRANTS[i]) & 1)
+            odd |= empties & QUADRANTS[i];
+    }
+    return odd;
+}
+
+/*
+ * Table key of an endgame position. It is deliberately not the Zobrist key
+ * the midgame search uses, so exact disc differences are never confused with
+ * heuristic scores stored for the same position.
+ */
+static inline uint64_t position_key(uint64_t self, uint64_t other)
+{
+    uint64_t key = (self ^ 0x3c6ef372fe94f82bULL) * 0x9e3779b97f4a7c15ULL;
+    key ^= key >> 29;
+    key += (other ^ 0xa54ff53a5f1d36f1ULL) * 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 32;
+    key *= 0x94d049bb133111ebULL;
+    return key ^ (key >> 29);
+}
+
+/*
+ * The solver stops early if time_manager's hard deadline passes; without a
+ * time manager it always runs to completion.
+ */
+EndgameSolver::EndgameSolver(TranspositionTable* transpositions_in,
+    TimeManager* time_manager_in)
+    : transpositions(transpositions_in),
+      time_manager(time_manager_in),
+      polls(0),
+      aborted(false)
+{
+    counters.clear();
+}
+
+/*
+ * Solves the position for the given side to move. Sets best_square to the
+ * best move, or -1 if the side must pass, and returns the exact score.
+ *
+ * If the solve is aborted, best_square is the best move among those fully
+ * searched, or the first move in fastest-first order if none were, and the
+ * score is meaningless.
+ */
+int EndgameSolver::solve_root(Board* board, char side, int* best_square)
+{
+    counters.clear();
+    aborted = false;
+    return solve(board->pieces(side), board->pieces(OTHER_SIDE(side)),
+        -max_score, max_score, false, best_square);
+}
+
+/*
+ * Last empty square: at most one side can play it, so no search is needed.
+ */
+int EndgameSolver::solve_1(uint64_t self, uint64_t other, int s1)
+{
+    counters.nodes++;
+    counters.leaves++;
+    int diff = popcount(self) - popcount(other);
+    uint64_t flips = find_flips(s1, self, other);
+    if(flips)
+        return diff + 2 * popcount(flips) + 1;
+
+    flips = find_flips(s1, other, self);
+    if(flips)
+        return diff - 2 * popcount(flips) - 1;
+
+    // 63 discs, so the difference is odd and the empty goes to the winner.
+    return diff > 0 ? diff + 1 : diff - 1;
+}
+
+int EndgameSolver::solve_2(uint64_t self, uint64_t other, int alpha, int beta,
+    int s1, int s2, bool passed)
+{
+    counters.nodes++;
+    int best = NO_SCORE;
+    uint64_t flips;
+
+    if((flips = find_flips(s1, self, other)))
+    {
+        best = -solve_1(other & ~flips, self | flips | (1ULL << s1), s2);
+        if(best >= beta)
+            return best;
+    }
+    if((flips = find_flips(s2, self, other)))
+    {
+        int score = -solve_1(other & ~flips, self | flips | (1ULL << s2), s1);
+        if(score > best)
+            best = score;
+    }
+
+    if(best == NO_SCORE)
+    {
+        if(passed)
+            return final_score(self, other);
+        return -solve_2(other, self, -beta, -alpha, s1, s2, true);
+    }
+    return best;
+}
+
+int EndgameSolver::solve_3(uint64_t self, uint64_t other, int alpha, int beta,
+    int s1, int s2, int s3, bool passed)
+{
+    counters.nodes++;
+    int best = NO_SCORE;
+    uint64_t flips;
+
+    if((flips = find_flips(s1, self, other)))
+    {
+        best = -solve_2(other & ~flips, self | flips | (1ULL << s1),
+            -beta, -alpha, s2, s3, false);
+        if(best >= beta)
+            return best;
+        if(best > alpha)
+            alpha = best;
+    }
+    if((flips = find_flips(s2, self, other)))
+    {
+        int score = -solve_2(other & ~flips, self | flips | (1ULL << s2),
+            -beta, -alpha, s1, s3, false);
+        if(score >= beta)
+            return score;
+        if(score > best)
+        {
+            best = score;
+            if(best > alpha)
+                alpha = best;
+        }
+    }
+    if((flips = find_flips(s3, self, other)))
+    {
+        int score = -solve_2(other & ~flips, self | flips | (1ULL << s3),
+            -beta, -alpha, s1, s2, false);
+        if(score > best)
+            best = score;
+    }
+
+    if(best == NO_SCORE)
+    {
+        if(passed)
+            return final_score(self, other);
+        return -solve_3(other, self, -beta, -alpha, s1, s2, s3, true);
+    }
+    return best;
+}
+
+int EndgameSolver::solve_4(uint64_t self, uint64_t other, int alpha, int beta,
+    int s1, int s2, int s3, int s4, bool passed)
+{
+    counters.nodes++;
+    int best = NO_SCORE;
+    uint64_t flips;
+    int squares[4] = { s1, s2, s3, s4 };
+
+    for(int i = 0; i < 4; i++)
+    {
+        int square = squares[i];
+        if(!(flips = find_flips(square, self, other)))
+            continue;
+
+        // The other three, still in parity order.
+        int rest[3];
+        for(int j = 0, k = 0; j < 4; j++)
+        {
+            if(j != i)
+                rest[k++] = squares[j];
+        }
+
+        int score = -solve_3(other & ~flips, self | flips | (1ULL << square),
+            -beta, -alpha, rest[0], rest[1], rest[2], false);
+        if(score > best)
+        {
+            best = score;
+            if(best >= beta)
+                return best;
+            if(best > alpha)
+                alpha = best;
+        }
+    }
+
+    if(best == NO_SCORE)
+    {
+        if(passed)
+            return final_score(self, other);
+        return -solve_4(other, self, -beta, -alpha, s1, s2, s3, s4, true);
+    }
+    return best;
+}
+
+/*
+ * General case: searches all moves and dispatches to the small kernels once
+ * four or fewer empties are left. best_square is only set at the root, which
+ * is also never cut off by the transposition table.
+ */
+int EndgameSolver::solve(uint64_t self, uint64_t other, int alpha, int beta,
+    bool passed, int* best_square)
+{
+    uint64_t empties = ~(self | other);
+    int n_empties = popcount(empties);
+
+    if(n_empties <= 4 && !best_square)
+    {
+        // Hand the remaining squares over odd quadrants first.
+        int squares[4];
+        int n = 0;
+        uint64_t odd = odd_quadrants(empties);
+        for(uint64_t bits = empties & odd; bits; )
+            squares[n++] = pop_square(bits);
+        for(uint64_t bits = empties & ~odd; bits; )
+            squares[n++] = pop_square(bits);
+
+        switch(n_empties)
+        {
+            case 4: return solve_4(self, other, alpha, beta, squares[0],
+                        squares[1], squares[2], squares[3], false);
+            case 3: return solve_3(self, other, alpha, beta, squares[0],
+                        squares[1], squares[2], false);
+            case 2: return solve_2(self, other, alpha, beta, squares[0],
+                        squares[1], false);
+            case 1: return solve_1(self, other, squares[0]);
+            default: return final_score(self, other);
+        }
+    }
+
+    counters.nodes++;
+    if(time_manager && (++polls & 1023) == 0 && time_manager->hard_expired())
+        aborted = true;
+    if(aborted)
+        return 0;
+
+    uint64_t moves = find_moves(self, other);
+    if(!moves)
+    {
+        if(best_square)
+            *best_square = -1;
+        if(passed)
+            return final_score(self, other);
+        return -solve(other, self, -beta, -alpha, true, nullptr);
+    }
+
+    int original_alpha = alpha;
+    int tt_move = -1;
+    uint64_t key = 0;
+    if(n_empties >= MIN_EMPTIES_FOR_TT)
+    {
+        OthelloNode node;
+        key = position_key(self, other);
+        counters.tt_probes++;
+        if(transpositions->probe(key, &node))
+        {
+            counters.tt_hits++;
+            tt_move = node.best_move;
+            if(!best_square && (node.bound == BOUND_EXACT
+                || (node.bound == BOUND_LOWER && node.score >= beta)
+                || (node.bound == BOUND_UPPER && node.score <= alpha)))
+                return node.score;
+        }
+    }
+
+    // Order the moves into a stack buffer, keeping their flips.
+    int squares[64];
+    uint64_t flip_sets[64];
+    int n = 0;
+    if(n_empties >= MIN_EMPTIES_FOR_FASTEST_FIRST)
+    {
+        // Fewest opponent replies first, counting corners twice; the table
+        // move and then odd-quadrant moves win ties.
+        uint64_t odd = odd_quadrants(empties);
+        int scores[64];
+        while(moves)
+        {
+            int square = pop_square(moves);
+            uint64_t flips = find_flips(square, self, other);
+            uint64_t replies = find_moves(other & ~flips,
+                self | flips | (1ULL << square));
+            int score = 4 * (popcount(replies) + popcount(replies & CORNERS));
+            if(square == tt_move)
+                score = -1000;
+            else if(odd & (1ULL << square))
+                score -= 1;
+
+            int i = n++;
+            for(; i > 0 && scores[i - 1] > score; i--)
+            {
+                scores[i] = scores[i - 1];
+                squares[i] = squares[i - 1];
+                flip_sets[i] = flip_sets[i - 1];
+            }
+            scores[i] = score;
+            squares[i] = square;
+            flip_sets[i] = flips;
+        }
+    }
+    else
+    {
+        uint64_t odd = odd_quadrants(empties);
+        for(uint64_t bits = moves & odd; bits; n++)
+        {
+            squares[n] = pop_square(bits);
+            flip_sets[n] = find_flips(squares[n], self, other);
+        }
+        for(uint64_t bits = moves & ~odd; bits; n++)
+        {
+            squares[n] = pop_square(bits);
+            flip_sets[n] = find_flips(squares[n], self, other);
+        }
+    }
+
+    // Principal variation search, as in the midgame: after the first move,
+    // a null window asks whether each move beats the best so far, and only
+    // those that do are solved again with the full window.
+    int best = NO_SCORE;
+    int best_move = -1;
+    if(best_square)
+        *best_square = squares[0];
+    for(int i = 0; i < n; i++)
+    {
+        uint64_t flips = flip_sets[i];
+        uint64_t next_self = other & ~flips;
+        uint64_t next_other = self | flips | (1ULL << squares[i]);
+        int score;
+        if(i == 0)
+            score = -solve(next_self, next_other, -beta, -alpha, false, nullptr);
+        else
+        {
+            score = -solve(next_self, next_other, -alpha - 1, -alpha, false, nullptr);
+            if(score > alpha && score < beta && !aborted)
+            {
+                counters.researches++;
+                score = -solve(next_self, next_other, -beta, -alpha, false, nullptr);
+            }
+        }
+        if(aborted)
+        {
+            if(best_square && best_move >= 0)
+                *best_square = best_move;
+            return best;
+        }
+        if(score > best)
+        {
+            best = score;
+            best_move = squares[i];
+            if(best > alpha)
+            {
+                alpha = best;
+                if(alpha >= beta)
+                {
+                    counters.cutoffs++;
+                    counters.first_move_cutoffs += i == 0;
+                    break;
+                }
+            }
+        }
+    }
+
+    if(key)
+    {
+        int bound = best <= original_alpha ? BOUND_UPPER
+                  : best >= beta ? BOUND_LOWER : BOUND_EXACT;
+        transpositions->store(key, n_empties, best, bound, best_move);
+        counters.tt_stores++;
+    }
+    if(best_square)
+        *best_square = best_move;
+    return best;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "board.hpp"
+#include "transposition_table.hpp"
+#include "time_manager.hpp"
+#include "search_stats.hpp"
+#include "common.hpp"
+#include <stdint.h>
+
+/*
+ * Exact solver for the last empty squares. Scores are final disc differences
+ * from the point of view of the side to move, with empty squares going to
+ * the winner, so they lie in [-64, 64].
+ *
+ * Works directly on the two bitboards instead of a Board. Positions with
+ * many empties are ordered fastest-first (fewest replies for the opponent)
+ * and cached in the shared transposition table; those with few are ordered
+ * by quadrant parity; the last four empties have kernels of their own.
+ */
+class EndgameSolver {
+private:
+    TranspositionTable* transpositions;
+    TimeManager* time_manager;
+    uint64_t polls;
+
+    int solve(uint64_t self, uint64_t other, int alpha, int beta, bool passed,
+        int* best_square);
+    int solve_4(uint64_t self, uint64_t other, int alpha, int beta,
+        int s1, int s2, int s3, int s4, bool passed);
+    int solve_3(uint64_t self, uint64_t other, int alpha, int beta,
+        int s1, int s2, int s3, bool passed);
+    int solve_2(uint64_t self, uint64_t other, int alpha, int beta,
+        int s1, int s2, bool passed);
+    int solve_1(uint64_t self, uint64_t other, int s1);
+
+public:
+    static const int max_score = 64;
+
+    SearchCounters counters;
+    bool aborted;   // The hard deadline passed before the solve finished
+
+    EndgameSolver(TranspositionTable* transpositions_in,
+        TimeManager* time_manager_in = nullptr);
+
+    int solve_root(Board* board, char side, int* best_square);
+};
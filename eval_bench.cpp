@@ -0,0 +1,112 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "evaluate.hpp"
+#include "pattern_eval.hpp"
+#include "player.hpp"
+using namespace std;
+
+// Times each evaluation kernel on its own over positions from random games,
+// and prints one JSON object per kernel with its cost per call. Each kernel
+// is timed as the evaluation uses it, for both sides where it needs both.
+
+static PatternEvaluator patterns;
+
+static int squares_kernel(uint64_t self, uint64_t other) {
+    return weighted_square_sum(self, other);
+}
+
+static int patterns_kernel(uint64_t self, uint64_t other) {
+    return patterns.evaluate(self, other);
+}
+
+static int mobility_kernel(uint64_t self, uint64_t other) {
+    return mobility(self, other) - mobility(other, self);
+}
+
+static int potential_mobility_kernel(uint64_t self, uint64_t other) {
+    return potential_mobility(self, other) - potential_mobility(other, self);
+}
+
+static int stability_kernel(uint64_t self, uint64_t other) {
+    return popcount(stable_discs(self, other)) - popcount(stable_discs(other, self));
+}
+
+static int parity_kernel(uint64_t self, uint64_t other) {
+    return odd_regions(~(self | other));
+}
+
+static int features_kernel(uint64_t self, uint64_t other) {
+    return feature_evaluation(self, other);
+}
+
+struct Kernel {
+    const char *name;
+    int (*run)(uint64_t, uint64_t);
+};
+
+static const Kernel kernels[] = {
+    { "squares", squares_kernel },
+    { "patterns", patterns_kernel },
+    { "mobility", mobility_kernel },
+    { "potential_mobility", potential_mobility_kernel },
+    { "stability", stability_kernel },
+    { "parity", parity_kernel },
+    { "features", features_kernel }
+};
+
+int main(int argc, char *argv[]) {
+    int games = argc > 1 ? atoi(argv[1]) : 2000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    if (games <= 0 || rounds <= 0) {
+        cerr << "usage: " << argv[0] << " [games [rounds]]" << endl;
+        exit(-1);
+    }
+    bool have_patterns = patterns.load(Player::pattern_file);
+
+    // Every position of some random games, from the side to move's view.
+    vector<pair<uint64_t, uint64_t> > positions;
+    uint64_t seed = 1;
+    for (int game = 0; game < games; game++) {
+        Board board;
+        char side = BLACK;
+        while (true) {
+            uint64_t moves = board.getMoves(side);
+            if (!moves) {
+                if (!board.getMoves(OTHER_SIDE(side))) break;
+                side = OTHER_SIDE(side);
+                continue;
+            }
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            int n = (seed >> 33) % popcount(moves);
+            while (n--) pop_square(moves);
+            UndoRecord undo;
+            board.makeMove(pop_square(moves), side, &undo);
+            side = OTHER_SIDE(side);
+            positions.push_back(make_pair(board.pieces(side), board.pieces(OTHER_SIDE(side))));
+        }
+    }
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (kernels[k].run == patterns_kernel && !have_patterns) {
+            printf("{\"kernel\": \"patterns\", \"skipped\": \"cannot load %s\"}\n",
+                Player::pattern_file);
+            continue;
+        }
+
+        long long checksum = 0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++)
+            for (size_t i = 0; i < positions.size(); i++)
+                checksum += kernels[k].run(positions[i].first, positions[i].second);
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+        printf("{\"kernel\": \"%s\", \"calls\": %llu, \"ns_per_call\": %.1f, "
+            "\"checksum\": %lld}\n", kernels[k].name,
+            (unsigned long long) positions.size() * rounds,
+            ns / ((double) positions.size() * rounds), checksum);
+    }
+    return 0;
+}
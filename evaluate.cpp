@@ -0,0 +1,136 @@
+#include "evaluate.hpp"
+
+static const uint64_t NOT_LEFT_EDGE  = 0xfefefefefefefefeULL;    // x != 0
+static const uint64_t NOT_RIGHT_EDGE = 0x7f7f7f7f7f7f7f7fULL;    // x != 7
+static const uint64_t LEFT_RIGHT     = 0x8181818181818181ULL;    // x is 0 or 7
+static const uint64_t TOP_BOTTOM     = 0xff000000000000ffULL;    // y is 0 or 7
+
+/*
+ * Squares whose line along each direction is completely filled. No disc on
+ * a full line can be flipped along it.
+ */
+static inline uint64_t full_rows(uint64_t filled)
+{
+    uint64_t r = filled & (filled >> 4);
+    r &= r >> 2;
+    r &= r >> 1;
+    return (r & 0x0101010101010101ULL) * 0xff;
+}
+
+static inline uint64_t full_columns(uint64_t filled)
+{
+    uint64_t c = filled & (filled >> 32);
+    c &= c >> 16;
+    c &= c >> 8;
+    return (c & 0xff) * 0x0101010101010101ULL;
+}
+
+// A square's diagonal is full if every square up and to one side of it is
+// filled and so is every square down and to the other. Each half is found by
+// ANDing in the board shifted 1, 2 and 4 steps along the line, with squares
+// whose line has already left the board let through by the masks.
+static inline uint64_t full_diagonals(uint64_t filled)
+{
+    uint64_t up = filled;
+    up &= 0xff80808080808080ULL | (up >> 9);
+    up &= 0xffffc0c0c0c0c0c0ULL | (up >> 18);
+    up &= 0xfffffffff0f0f0f0ULL | (up >> 36);
+    uint64_t down = filled;
+    down &= 0x01010101010101ffULL | (down << 9);
+    down &= 0x030303030303ffffULL | (down << 18);
+    down &= 0x0f0f0f0fffffffffULL | (down << 36);
+    return up & down;
+}
+
+static inline uint64_t full_anti_diagonals(uint64_t filled)
+{
+    uint64_t up = filled;
+    up &= 0xff01010101010101ULL | (up >> 7);
+    up &= 0xffff030303030303ULL | (up >> 14);
+    up &= 0xffffffff0f0f0f0fULL | (up >> 28);
+    uint64_t down = filled;
+    down &= 0x80808080808080ffULL | (down << 7);
+    down &= 0xc0c0c0c0c0c0ffffULL | (down << 14);
+    down &= 0xf0f0f0f0ffffffffULL | (down << 28);
+    return up & down;
+}
+
+/*
+ * Discs of self's that can never be flipped: along each of the four lines
+ * through it, the line is full, or the disc is on the edge, or it has a
+ * stable disc of its own beside it. Stability spreads from the corners and
+ * from full lines until nothing changes. This misses some stable discs but
+ * never counts an unstable one.
+ */
+uint64_t stable_discs(uint64_t self, uint64_t other)
+{
+    uint64_t filled = self | other;
+    uint64_t horizontal = full_rows(filled) | LEFT_RIGHT;
+    uint64_t vertical = full_columns(filled) | TOP_BOTTOM;
+    uint64_t diagonal = full_diagonals(filled) | LEFT_RIGHT | TOP_BOTTOM;
+    uint64_t anti_diagonal = full_anti_diagonals(filled) | LEFT_RIGHT | TOP_BOTTOM;
+
+    uint64_t stable = self & horizontal & vertical & diagonal & anti_diagonal;
+    uint64_t previous = 0;
+    while(stable != previous)
+    {
+        previous = stable;
+        stable |= self
+            & (horizontal | ((stable << 1) & NOT_LEFT_EDGE) | ((stable >> 1) & NOT_RIGHT_EDGE))
+            & (vertical | (stable << 8) | (stable >> 8))
+            & (diagonal | ((stable << 9) & NOT_LEFT_EDGE) | ((stable >> 9) & NOT_RIGHT_EDGE))
+            & (anti_diagonal | ((stable << 7) & NOT_RIGHT_EDGE) | ((stable >> 7) & NOT_LEFT_EDGE));
+    }
+    return stable;
+}
+
+/*
+ * Weight of each feature at one point of the game, in the units of
+ * square_weights.
+ */
+struct FeatureWeights
+{
+    int squares;
+    int mobility;
+    int potential_mobility;
+    int stability;
+    int parity;
+};
+
+// Weights at 20, 40 and 60 discs on the board; in between they are blended
+// linearly, and outside they are held at the nearest set.
+static const int taper_discs[3] = { 20, 40, 60 };
+static const FeatureWeights taper_weights[3] = {
+    { 2, 6, 3,  8, 0 },     // Opening: keep quiet and mobile
+    { 3, 5, 2, 12, 1 },     // Midgame
+    { 2, 2, 1, 16, 6 }      // Endgame: discs that stay and the last move
+};
+
+/*
+ * Sum of the features, each weighted for how far into the game the position
+ * is, from self's point of view.
+ */
+int feature_evaluation(uint64_t self, uint64_t other)
+{
+    uint64_t empties = ~(self | other);
+    int squares = weighted_square_sum(self, other);
+    int moves = mobility(self, other) - mobility(other, self);
+    int potential = potential_mobility(self, other) - potential_mobility(other, self);
+    int stable = popcount(stable_discs(self, other)) - popcount(stable_discs(other, self));
+    int parity = popcount(empties) & 1 ? odd_regions(empties) : -odd_regions(empties);
+
+    // Find the two weight sets the position lies between.
+    int discs = 64 - popcount(empties);
+    int i = discs < taper_discs[1] ? 0 : 1;
+    int t = discs - taper_discs[i];
+    int span = taper_discs[i + 1] - taper_discs[i];
+    t = t < 0 ? 0 : t > span ? span : t;
+
+    const FeatureWeights& a = taper_weights[i];
+    const FeatureWeights& b = taper_weights[i + 1];
+    int score_a = a.squares * squares + a.mobility * moves
+        + a.potential_mobility * potential + a.stability * stable + a.parity * parity;
+    int score_b = b.squares * squares + b.mobility * moves
+        + b.potential_mobility * potential + b.stability * stable + b.parity * parity;
+    return (score_a * (span - t) + score_b * t) / span;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "board.hpp"
+#include <stdint.h>
+
+/*
+ * Static value of a disc on each square, indexed by SQUARE(x, y). Corners
+ * are good, the squares next to them bad, edges and the centre mildly good.
+ */
+static constexpr int square_weights[64] = {
+     5, -3,  2,  2,  2,  2, -3,  5,
+    -3, -5, -1, -1, -1, -1, -5, -3,
+     2, -1,  1,  0,  0,  1, -1,  2,
+     2, -1,  0,  1,  1,  0, -1,  2,
+     2, -1,  0,  1,  1,  0, -1,  2,
+     2, -1,  1,  0,  0,  1, -1,  2,
+    -3, -5, -1, -1, -1, -1, -5, -3,
+     5, -3,  2,  2,  2,  2, -3,  5
+};
+
+/*
+ * Mask of the squares (from square onwards) whose weight is w. Recursive so
+ * that it is a C++11 constexpr.
+ */
+static constexpr uint64_t weight_class_mask(int w, int square = 0)
+{
+    return square == 64 ? 0
+        : (square_weights[square] == w ? 1ULL << square : 0)
+            | weight_class_mask(w, square + 1);
+}
+
+/*
+ * The table has only six distinct non-zero weights, so the sum over discs
+ * is six popcount differences. weight_classes lists them with their masks.
+ */
+struct WeightClass
+{
+    int weight;
+    uint64_t mask;
+};
+
+static constexpr WeightClass weight_classes[] = {
+    {  5, weight_class_mask(5) },
+    {  2, weight_class_mask(2) },
+    {  1, weight_class_mask(1) },
+    { -1, weight_class_mask(-1) },
+    { -3, weight_class_mask(-3) },
+    { -5, weight_class_mask(-5) }
+};
+
+static_assert((weight_class_mask(5) | weight_class_mask(2) | weight_class_mask(1)
+    | weight_class_mask(0) | weight_class_mask(-1) | weight_class_mask(-3)
+    | weight_class_mask(-5)) == ~0ULL,
+    "weight_classes must cover every weight in square_weights");
+
+/*
+ * Sum of square_weights over self's discs minus the sum over other's.
+ *
+ * With a hardware popcount this is twelve popcounts and no branches. Without
+ * one, __builtin_popcountll is a library call, so the fallback walks the
+ * occupied squares through the table instead; it is no slower than software
+ * popcounts and much faster early in the game when there are few discs.
+ */
+static inline int weighted_square_sum(uint64_t self, uint64_t other)
+{
+    int total = 0;
+#if defined(__POPCNT__)
+    for(const WeightClass& c : weight_classes)
+        total += c.weight * (popcount(self & c.mask) - popcount(other & c.mask));
+#else
+    while(self)
+        total += square_weights[pop_square(self)];
+    while(other)
+        total -= square_weights[pop_square(other)];
+#endif
+    return total;
+}
+
+/*
+ * Feature kernels for the tapered evaluation. Each works on the two
+ * bitboards alone; eval_bench times them one by one.
+ */
+
+// Squares next to (horizontally, vertically or diagonally) any of bits.
+static inline uint64_t neighbours(uint64_t bits)
+{
+    uint64_t row = bits | ((bits << 1) & 0xfefefefefefefefeULL)
+        | ((bits >> 1) & 0x7f7f7f7f7f7f7f7fULL);
+    return row | (row << 8) | (row >> 8);
+}
+
+// Number of legal moves for self.
+static inline int mobility(uint64_t self, uint64_t other)
+{
+    return popcount(find_moves(self, other));
+}
+
+// Empty squares next to other's discs: where self may get moves later. The
+// fewer of these a side gives its opponent, the fewer frontier discs it has.
+static inline int potential_mobility(uint64_t self, uint64_t other)
+{
+    return popcount(neighbours(other) & ~(self | other));
+}
+
+// Quadrants with an odd number of empty squares. The side that moves into
+// such a region can expect to play its last square too.
+static inline int odd_regions(uint64_t empties)
+{
+    return (popcount(empties & 0x000000000f0f0f0fULL) & 1)
+        + (popcount(empties & 0x00000000f0f0f0f0ULL) & 1)
+        + (popcount(empties & 0x0f0f0f0f00000000ULL) & 1)
+        + (popcount(empties & 0xf0f0f0f000000000ULL) & 1);
+}
+
+uint64_t stable_discs(uint64_t self, uint64_t other);
+int feature_evaluation(uint64_t self, uint64_t other);
@@ -0,0 +1,328 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "match_stats.hpp"
+#include "player.hpp"
+#include "random.hpp"
+using namespace std;
+
+// Plays a match between two engine configurations, A and B, with one game
+// per core at a time.
+//
+// Each opening is played twice with the colours swapped. The openings are
+// random games of --plies plies, or the games in an --openings file, one per
+// line as coordinates, e.g. "f5d6c3d3c4".
+//
+// An engine is a comma-separated list of settings, or "default":
+//   engine=alphabeta|mcts
+//   eval=squares|patterns|features
+//   endgame=N      solve exactly at N empties or fewer (0 for never)
+//   depth=N        search to depth N each move
+//   nodes=N        search about N nodes (or MCTS playouts) each move
+//   mpc=T          Multi-ProbCut confidence, 0 for off
+// An engine with neither depth nor nodes plays on a clock of --time ms per
+// game, and loses a game if it runs out.
+//
+// Each player's transposition table is --hash MB (4 by default, against 32
+// in play) and is cleared before every game, so a smaller one plays more
+// games per second but searches a little less well at long time controls.
+//
+// Prints a progress line every few pairs to stderr and the final results as
+// JSON to stdout. With --sprt ELO0 ELO1 the match also runs a sequential
+// probability ratio test of A being ELO1 Elo stronger against ELO0, and
+// stops as soon as it reaches a verdict.
+
+struct Engine {
+    string spec;
+    SearchEngine search_engine;
+    bool set_evaluation;
+    Evaluation evaluation;
+    int endgame_empties;    // -1 for the player's default
+    int depth;              // 0 for no fixed depth
+    uint64_t nodes;         // 0 for no node limit
+    float mpc;              // -1 for the player's default
+
+    bool timed() const { return depth == 0 && nodes == 0; }
+};
+
+static bool parse_engine(const string& spec, Engine *engine) {
+    engine->spec = spec;
+    engine->search_engine = ENGINE_ALPHA_BETA;
+    engine->set_evaluation = false;
+    engine->endgame_empties = -1;
+    engine->depth = 0;
+    engine->nodes = 0;
+    engine->mpc = -1;
+    if (spec == "default") return true;
+
+    stringstream settings(spec);
+    string setting;
+    while (getline(settings, setting, ',')) {
+        size_t equals = setting.find('=');
+        if (equals == string::npos) return false;
+        string key = setting.substr(0, equals), value = setting.substr(equals + 1);
+        if (key == "engine") {
+            if (value == "alphabeta") engine->search_engine = ENGINE_ALPHA_BETA;
+            else if (value == "mcts") engine->search_engine = ENGINE_MCTS;
+            else return false;
+        }
+        else if (key == "eval") {
+            if (!parse_evaluation(value.c_str(), &engine->evaluation)) return false;
+            engine->set_evaluation = true;
+        }
+        else if (key == "endgame") engine->endgame_empties = atoi(value.c_str());
+        else if (key == "depth") engine->depth = atoi(value.c_str());
+        else if (key == "nodes") engine->nodes = strtoull(value.c_str(), nullptr, 10);
+        else if (key == "mpc") engine->mpc = atof(value.c_str());
+        else return false;
+    }
+    return true;
+}
+
+struct Opening {
+    Board board;
+    char side;      // To move
+};
+
+// Plays random moves from the start, starting again if the game ends first.
+static Opening random_opening(Random& random, int plies) {
+    while (true) {
+        Opening opening;
+        opening.side = BLACK;
+        int ply = 0;
+        while (ply < plies) {
+            uint64_t moves = opening.board.getMoves(opening.side);
+            if (!moves) {
+                if (!opening.board.getMoves(OTHER_SIDE(opening.side))) break;
+                opening.side = OTHER_SIDE(opening.side);
+                continue;
+            }
+            int n = random() % popcount(moves);
+            while (n--) pop_square(moves);
+            UndoRecord undo;
+            opening.board.makeMove(pop_square(moves), opening.side, &undo);
+            opening.side = OTHER_SIDE(opening.side);
+            ply++;
+        }
+        if (!opening.board.hasMoves(opening.side))
+            opening.side = OTHER_SIDE(opening.side);
+        if (ply == plies && opening.board.hasMoves(opening.side)) return opening;
+    }
+}
+
+// Plays the moves of one opening line, stopping at the first illegal one.
+static bool parse_opening(const string& line, Opening *opening) {
+    opening->board = Board();
+    opening->side = BLACK;
+    int plies = 0;
+    for (size_t i = 0; i + 1 < line.size(); i++) {
+        char file = tolower(line[i]), rank = line[i + 1];
+        if (file < 'a' || file > 'h' || rank < '1' || rank > '8') continue;
+        i++;
+        if (!opening->board.hasMoves(opening->side))
+            opening->side = OTHER_SIDE(opening->side);
+        int square = SQUARE(file - 'a', rank - '1');
+        if (!(opening->board.getMoves(opening->side) >> square & 1)) break;
+        UndoRecord undo;
+        opening->board.makeMove(square, opening->side, &undo);
+        opening->side = OTHER_SIDE(opening->side);
+        plies++;
+    }
+    if (!opening->board.hasMoves(opening->side))
+        opening->side = OTHER_SIDE(opening->side);
+    return plies > 0 && opening->board.hasMoves(opening->side);
+}
+
+static Player *make_player(const Engine& engine, char side, int tt_log2) {
+    Player *player = new Player(side, 1, engine.search_engine, tt_log2);
+    player->set_stats_file("/dev/null");
+    if (engine.set_evaluation) player->set_evaluation(engine.evaluation);
+    if (engine.endgame_empties >= 0) player->set_endgame_empties(engine.endgame_empties);
+    if (engine.mpc >= 0) player->set_probcut_confidence(engine.mpc);
+    if (engine.depth) player->set_depth(engine.depth);
+    if (engine.nodes) {
+        player->set_depth(Player::max_depth);
+        player->set_node_limit(engine.nodes);
+    }
+    return player;
+}
+
+// Plays one game between two players, each with a fresh table, and returns
+// its final disc difference for black. A player that runs out of time or
+// makes an illegal move loses 64-0, and forfeits is incremented.
+static int play_game(const Opening& opening, Player *black, const Engine& black_engine,
+                     Player *white, const Engine& white_engine, int time_ms,
+                     atomic<int> *forfeits) {
+    const Engine *engines[2] = { &black_engine, &white_engine };
+    Player *players[2] = { black, white };
+    for (int i = 0; i < 2; i++) {
+        players[i]->new_game();
+        players[i]->set_board(new Board(opening.board));
+    }
+    long long clock_ms[2] = { time_ms, time_ms };
+    Board board = opening.board;
+    char side = opening.side;
+    Move *last = nullptr;
+    int passes = 0;
+    int result = 0;
+    while (passes < 2) {
+        int i = side == WHITE;
+        bool timed = engines[i]->timed();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        Move *move = players[i]->doMove(last, timed ? clock_ms[i] : -1);
+        clock_ms[i] -= chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - start).count();
+
+        bool legal = move ? board.checkMove(move, side) : !board.hasMoves(side);
+        if (!legal || (timed && clock_ms[i] < 0)) {
+            (*forfeits)++;
+            result = side == BLACK ? -64 : 64;
+            delete move;
+            break;
+        }
+        board.doMove(move, side);
+        delete last;
+        last = move;
+        passes = move ? 0 : passes + 1;
+        side = OTHER_SIDE(side);
+    }
+    if (passes == 2) result = board.count(BLACK) - board.count(WHITE);
+
+    delete last;
+    return result;
+}
+
+static double game_score(int disc_difference) {
+    return disc_difference > 0 ? 1 : disc_difference < 0 ? 0 : 0.5;
+}
+
+int main(int argc, char *argv[]) {
+    int games = 1000, concurrency = 0, time_ms = 10000, plies = 8, hash_mb = 4;
+    uint64_t seed = 1;
+    const char *openings_file = nullptr;
+    bool sprt = false;
+    double elo0 = 0, elo1 = 0;
+    vector<string> specs;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--games") && i + 1 < argc) games = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--concurrency") && i + 1 < argc) concurrency = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--time") && i + 1 < argc) time_ms = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--plies") && i + 1 < argc) plies = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--hash") && i + 1 < argc) hash_mb = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--openings") && i + 1 < argc) openings_file = argv[++i];
+        else if (!strcmp(argv[i], "--sprt") && i + 2 < argc) {
+            sprt = true;
+            elo0 = atof(argv[++i]);
+            elo1 = atof(argv[++i]);
+        }
+        else if (argv[i][0] != '-') specs.push_back(argv[i]);
+        else specs.clear(), i = argc;
+    }
+
+    Engine engines[2];
+    if (specs.size() != 2 || !parse_engine(specs[0], &engines[0])
+        || !parse_engine(specs[1], &engines[1]) || games < 2 || plies < 0) {
+        cerr << "usage: " << argv[0] << " [--games N] [--concurrency N] [--time MS] [--hash MB]"
+             << " [--plies N | --openings FILE] [--seed N] [--sprt ELO0 ELO1]"
+             << " engine_a engine_b" << endl
+             << "  engine: default, or settings engine=NAME,eval=NAME,endgame=N,"
+             << "depth=N,nodes=N,mpc=T" << endl;
+        exit(-1);
+    }
+    for (int i = 0; i < 2; i++) {
+        Player player(BLACK, 1, ENGINE_ALPHA_BETA, TranspositionTable::log2_entries(0));
+        if (engines[i].set_evaluation && !player.set_evaluation(engines[i].evaluation)) {
+            cerr << "cannot load " << Player::pattern_file << endl;
+            exit(-1);
+        }
+    }
+    if (concurrency <= 0) concurrency = max(1u, thread::hardware_concurrency());
+    int tt_log2 = TranspositionTable::log2_entries(hash_mb);
+    int pairs = (games + 1) / 2;
+
+    vector<Opening> openings;
+    if (openings_file) {
+        ifstream input(openings_file);
+        if (!input) {
+            cerr << "cannot open " << openings_file << endl;
+            exit(-1);
+        }
+        string line;
+        Opening opening;
+        while (getline(input, line))
+            if (parse_opening(line, &opening)) openings.push_back(opening);
+        if (openings.empty()) {
+            cerr << "no openings in " << openings_file << endl;
+            exit(-1);
+        }
+        // Shuffle, so a short match does not play only the first lines.
+        Random random(seed);
+        for (size_t i = openings.size(); i > 1; i--)
+            swap(openings[i - 1], openings[random() % i]);
+    } else {
+        Random random(seed);
+        for (int i = 0; i < pairs; i++) openings.push_back(random_opening(random, plies));
+    }
+
+    MatchStats stats;
+    mutex stats_lock;
+    atomic<int> next_pair(0), forfeits(0);
+    atomic<bool> decided(false);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    vector<thread> workers;
+    for (int t = 0; t < concurrency; t++) {
+        workers.push_back(thread([&]() {
+            // One player per engine and colour, reused from game to game.
+            Player *a[2] = { make_player(engines[0], BLACK, tt_log2),
+                             make_player(engines[0], WHITE, tt_log2) };
+            Player *b[2] = { make_player(engines[1], BLACK, tt_log2),
+                             make_player(engines[1], WHITE, tt_log2) };
+            for (int pair = next_pair++; pair < pairs && !decided; pair = next_pair++) {
+                const Opening& opening = openings[pair % openings.size()];
+                double first = game_score(play_game(opening, a[0], engines[0],
+                    b[1], engines[1], time_ms, &forfeits));
+                double second = 1 - game_score(play_game(opening, b[0], engines[1],
+                    a[1], engines[0], time_ms, &forfeits));
+
+                lock_guard<mutex> lock(stats_lock);
+                stats.add_pair(first, second);
+                if (sprt && strcmp(stats.sprt(elo0, elo1), "continue")) decided = true;
+                if (stats.games() % 20 == 0) {
+                    cerr << "{";
+                    stats.write_json(cerr);
+                    if (sprt) cerr << ", \"llr\": " << stats.llr(elo0, elo1);
+                    cerr << "}" << endl;
+                }
+            }
+            for (int i = 0; i < 2; i++) {
+                delete a[i];
+                delete b[i];
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "{\"engine_a\": \"" << engines[0].spec << "\", \"engine_b\": \""
+         << engines[1].spec << "\", ";
+    stats.write_json(cout);
+    cout << ", \"forfeits\": " << forfeits;
+    if (sprt)
+        cout << ", \"elo0\": " << elo0 << ", \"elo1\": " << elo1
+             << ", \"llr\": " << stats.llr(elo0, elo1)
+             << ", \"sprt\": \"" << stats.sprt(elo0, elo1) << "\"";
+    cout << ", \"concurrency\": " << concurrency << ", \"seconds\": " << seconds
+         << ", \"games_per_second\": " << stats.games() / max(seconds, 1e-9) << "}" << endl;
+    return 0;
+}
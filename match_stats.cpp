@@ -0,0 +1,120 @@
+#include "match_stats.hpp"
+#include <algorithm>
+#include <cmath>
+
+// False positive and false negative rates of the SPRT.
+const double MatchStats::sprt_alpha = 0.05;
+const double MatchStats::sprt_beta = 0.05;
+
+// Elo reported for a score of 0 or 1, where the logistic curve has none.
+static const double MAX_ELO = 1000;
+
+static double elo_from_score(double score)
+{
+    if(score <= 0)
+        return -MAX_ELO;
+    if(score >= 1)
+        return MAX_ELO;
+    return std::max(-MAX_ELO, std::min(MAX_ELO, 400 * std::log10(score / (1 - score))));
+}
+
+static double score_from_elo(double elo)
+{
+    return 1 / (1 + std::pow(10, -elo / 400));
+}
+
+MatchStats::MatchStats()
+    : pairs(0), wins(0), draws(0), losses(0), pair_sum(0), pair_sum_squares(0)
+{
+}
+
+/*
+ * Adds the scores A made in the two games of a pair: 1 for a win, 0.5 for a
+ * draw and 0 for a loss.
+ */
+void MatchStats::add_pair(double first, double second)
+{
+    double game_scores[2] = { first, second };
+    for(int i = 0; i < 2; i++)
+    {
+        wins += game_scores[i] == 1;
+        draws += game_scores[i] == 0.5;
+        losses += game_scores[i] == 0;
+    }
+    double mean = (first + second) / 2;
+    pairs++;
+    pair_sum += mean;
+    pair_sum_squares += mean * mean;
+}
+
+/*
+ * A's mean score per game.
+ */
+double MatchStats::score() const
+{
+    return pairs ? pair_sum / pairs : 0.5;
+}
+
+double MatchStats::elo() const
+{
+    return elo_from_score(score());
+}
+
+/*
+ * Half the width of the 95% confidence interval of elo(), from the spread of
+ * the pair scores.
+ */
+double MatchStats::elo_error() const
+{
+    if(pairs < 2)
+        return MAX_ELO;
+    double mean = score();
+    double variance = std::max(pair_sum_squares / pairs - mean * mean, 0.0);
+    double margin = 1.96 * std::sqrt(variance / pairs);
+    return (elo_from_score(mean + margin) - elo_from_score(mean - margin)) / 2;
+}
+
+/*
+ * Log-likelihood ratio of A being elo1 stronger than B against it being
+ * elo0 stronger, taking the mean pair score as normally distributed.
+ */
+double MatchStats::llr(double elo0, double elo1) const
+{
+    if(pairs < 2)
+        return 0;
+    double mean = score();
+    double variance = pair_sum_squares / pairs - mean * mean;
+    if(variance <= 0)
+        return 0;
+    double s0 = score_from_elo(elo0), s1 = score_from_elo(elo1);
+    return pairs * (s1 - s0) * (2 * mean - s0 - s1) / (2 * variance);
+}
+
+/*
+ * Verdict of the SPRT between elo0 and elo1: "H1" if A is elo1 stronger,
+ * "H0" if it is no more than elo0 stronger, or "continue" if it is too early
+ * to say.
+ */
+const char* MatchStats::sprt(double elo0, double elo1) const
+{
+    double ratio = llr(elo0, elo1);
+    if(ratio >= std::log((1 - sprt_beta) / sprt_alpha))
+        return "H1";
+    if(ratio <= std::log(sprt_beta / (1 - sprt_alpha)))
+        return "H0";
+    return "continue";
+}
+
+/*
+ * Writes the results as JSON members, without the enclosing braces.
+ */
+void MatchStats::write_json(std::ostream& out) const
+{
+    out << "\"games\": " << games()
+        << ", \"wins\": " << wins
+        << ", \"draws\": " << draws
+        << ", \"losses\": " << losses
+        << ", \"score\": " << score()
+        << ", \"elo\": " << elo()
+        << ", \"elo_error\": " << elo_error();
+}
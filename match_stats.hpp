@@ -0,0 +1,32 @@
+#pragma once
+
+#include <ostream>
+
+/*
+ * Results of a match between two engines, A and B, played in pairs of games
+ * from the same opening with the colours swapped. The pair is the unit of
+ * the statistics: the openings make the two games of a pair correlated, so
+ * counting them as independent games would understate the error.
+ */
+class MatchStats {
+private:
+    int pairs;
+    int wins, draws, losses;    // Games, from A's point of view
+    double pair_sum;            // Sum over pairs of A's mean score in the pair
+    double pair_sum_squares;
+
+public:
+    static const double sprt_alpha;
+    static const double sprt_beta;
+
+    MatchStats();
+
+    void add_pair(double first, double second);
+    int games() const { return 2 * pairs; }
+    double score() const;
+    double elo() const;
+    double elo_error() const;
+    double llr(double elo0, double elo1) const;
+    const char* sprt(double elo0, double elo1) const;
+    void write_json(std::ostream& out) const;
+};
@@ -0,0 +1,336 @@
+#include "mcts.hpp"
+#include "board.hpp"
+#include <cmath>
+#include <thread>
+#include <vector>
+
+const float MonteCarloSearch::exploration = 1.0f;
+
+static const uint64_t corners = 0x8100000000000081ULL;
+
+/*
+ * Plays move, a square or MonteCarloSearch::pass_move, for self, then swaps
+ * the sides so that self is again the side to move.
+ */
+static inline void play(int move, uint64_t& self, uint64_t& other)
+{
+    if(move != MonteCarloSearch::pass_move)
+    {
+        uint64_t flips = find_flips(move, self, other);
+        self |= flips | (1ULL << move);
+        other &= ~flips;
+    }
+    uint64_t swap = self;
+    self = other;
+    other = swap;
+}
+
+/*
+ * Plays the game out from the position and returns the half points (0, 1
+ * or 2) of the side to move in it. Moves are uniformly random, except that
+ * a corner is always taken when one is on offer.
+ */
+static int playout(uint64_t self, uint64_t other, Random& random)
+{
+    bool swapped = false;
+    while(true)
+    {
+        uint64_t moves = find_moves(self, other);
+        if(moves)
+        {
+            if(moves & corners)
+                moves &= corners;
+            uint64_t n = ((random() >> 32) * popcount(moves)) >> 32;
+            while(n--)
+                moves &= moves - 1;
+            play(pop_square(moves), self, other);
+        }
+        else if(find_moves(other, self))
+        {
+            play(MonteCarloSearch::pass_move, self, other);
+        }
+        else
+        {
+            break;
+        }
+        swapped = !swapped;
+    }
+    int difference = popcount(self) - popcount(other);
+    if(swapped)
+        difference = -difference;
+    return difference > 0 ? 2 : difference == 0 ? 1 : 0;
+}
+
+MonteCarloSearch::MonteCarloSearch(int log2_nodes)
+    : pool(new Node[1u << log2_nodes]),
+      capacity(1u << log2_nodes),
+      used(0),
+      root(0),
+      root_self(0),
+      root_other(0),
+      stop(false),
+      playouts(0)
+{
+}
+
+MonteCarloSearch::~MonteCarloSearch()
+{
+    delete[] pool;
+}
+
+/*
+ * Empties the pool, forgetting the tree.
+ */
+void MonteCarloSearch::clear()
+{
+    used = 0;
+}
+
+/*
+ * Takes a block of count nodes from the pool and returns the index of the
+ * first, or capacity if the pool is full. A failed allocation leaves used
+ * as it was, so it never passes capacity.
+ */
+uint32_t MonteCarloSearch::allocate(uint32_t count)
+{
+    uint32_t first = used.load(std::memory_order_relaxed);
+    do
+    {
+        if(count > capacity - first)
+            return capacity;
+    }
+    while(!used.compare_exchange_weak(first, first + count, std::memory_order_relaxed));
+    return first;
+}
+
+void MonteCarloSearch::init_node(uint32_t index, int move)
+{
+    Node& node = pool[index];
+    node.visits.store(0, std::memory_order_relaxed);
+    node.reward.store(0, std::memory_order_relaxed);
+    node.state.store(UNEXPANDED, std::memory_order_relaxed);
+    node.move = move;
+    node.num_children = 0;
+    node.first_child = 0;
+}
+
+/*
+ * Gives the node at index, whose position is (self, other), a child for
+ * each legal move, or a single pass child if there are none and the
+ * opponent can move. Returns false if another thread is expanding it or
+ * the pool is full.
+ */
+bool MonteCarloSearch::expand(uint32_t index, uint64_t self, uint64_t other)
+{
+    Node& node = pool[index];
+    uint8_t state = UNEXPANDED;
+    if(!node.state.compare_exchange_strong(state, EXPANDING, std::memory_order_acquire))
+        return state == EXPANDED;
+
+    uint64_t moves = find_moves(self, other);
+    int count = popcount(moves);
+    if(!count && find_moves(other, self))
+        count = 1;
+    uint32_t first = allocate(count);
+    if(first == capacity)
+    {
+        node.state.store(UNEXPANDED, std::memory_order_release);
+        return false;
+    }
+    for(int i = 0; i < count; i++)
+        init_node(first + i, moves ? pop_square(moves) : pass_move);
+    node.first_child = first;
+    node.num_children = count;
+    node.state.store(EXPANDED, std::memory_order_release);
+    return true;
+}
+
+/*
+ * Returns the child of an expanded node with the highest UCT value: its
+ * mean reward plus exploration * sqrt(ln(parent visits) / visits). A child
+ * never visited comes first.
+ */
+uint32_t MonteCarloSearch::select(const Node& parent)
+{
+    float log_visits = std::log((float) parent.visits.load(std::memory_order_relaxed));
+    uint32_t best = parent.first_child;
+    float best_value = -1.0f;
+    for(uint32_t i = parent.first_child; i < parent.first_child + parent.num_children; i++)
+    {
+        uint32_t visits = pool[i].visits.load(std::memory_order_relaxed);
+        if(!visits)
+            return i;
+        float value = pool[i].reward.load(std::memory_order_relaxed) / (2.0f * visits)
+            + exploration * std::sqrt(log_visits / visits);
+        if(value > best_value)
+        {
+            best_value = value;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/*
+ * Moves the root to the node of (self, other), if it is the root itself or
+ * one or two plies below it: after our move, or after it and the opponent's
+ * reply. Either may be a pass.
+ */
+bool MonteCarloSearch::find_root(uint64_t self, uint64_t other)
+{
+    if(!used)
+        return false;
+    if(self == root_self && other == root_other)
+        return true;
+
+    const Node& node = pool[root];
+    if(node.state.load(std::memory_order_acquire) != EXPANDED)
+        return false;
+    for(uint32_t i = node.first_child; i < node.first_child + node.num_children; i++)
+    {
+        const Node& child = pool[i];
+        uint64_t child_self = root_self, child_other = root_other;
+        play(child.move, child_self, child_other);
+        if(child_self == self && child_other == other)
+        {
+            root = i;
+            root_self = self;
+            root_other = other;
+            return true;
+        }
+        if(child.state.load(std::memory_order_acquire) != EXPANDED)
+            continue;
+        for(uint32_t j = child.first_child; j < child.first_child + child.num_children; j++)
+        {
+            uint64_t reply_self = child_self, reply_other = child_other;
+            play(pool[j].move, reply_self, reply_other);
+            if(reply_self == self && reply_other == other)
+            {
+                root = j;
+                root_self = self;
+                root_other = other;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * One playout: select down the tree from the root, expand the node reached
+ * if it has been visited before, play out from it, and back the result up.
+ */
+void MonteCarloSearch::iterate(Random& random)
+{
+    uint32_t path[max_path];
+    int length = 0;
+    uint64_t self = root_self, other = root_other;
+    uint32_t index = root;
+    pool[index].visits.fetch_add(1, std::memory_order_relaxed);
+    path[length++] = index;
+
+    while(length < max_path)
+    {
+        Node& node = pool[index];
+        if(node.state.load(std::memory_order_acquire) != EXPANDED
+            && (node.visits.load(std::memory_order_relaxed) < 2
+                || !expand(index, self, other)))
+            break;
+        if(!node.num_children)
+            break;
+        index = select(node);
+        play(pool[index].move, self, other);
+        pool[index].visits.fetch_add(1, std::memory_order_relaxed);
+        path[length++] = index;
+    }
+
+    // Each node is credited with the points of the side that moved into it.
+    int points = playout(self, other, random);
+    for(int i = length - 1; i >= 0; i--)
+    {
+        points = 2 - points;
+        pool[path[i]].reward.fetch_add(points, std::memory_order_relaxed);
+    }
+}
+
+/*
+ * Body of each search thread. Thread 0 watches the clock and stops them
+ * all at the soft deadline; any thread stops them at the playout limit.
+ */
+void MonteCarloSearch::run(int id, TimeManager* time_manager, uint64_t playout_limit)
+{
+    // One generator per thread.
+    Random random(root_self * 0x9e3779b97f4a7c15ULL ^ root_other ^ (uint64_t) id << 56);
+    uint64_t own_playouts = 0;
+    while(!stop.load(std::memory_order_relaxed))
+    {
+        iterate(random);
+        uint64_t total = playouts.fetch_add(1, std::memory_order_relaxed) + 1;
+        if(playout_limit && total >= playout_limit)
+            stop = true;
+        if(id == 0 && (++own_playouts & 63) == 0 && time_manager->soft_expired())
+            stop = true;
+    }
+}
+
+/*
+ * Searches the position with self to move until the soft deadline of
+ * time_manager, which the caller has started, or until playout_limit
+ * playouts if that is not 0, on num_threads threads. The best move is the
+ * one played out most often.
+ */
+MctsResult MonteCarloSearch::search(uint64_t self, uint64_t other,
+    TimeManager* time_manager, uint64_t playout_limit, int num_threads)
+{
+    // Keep the tree if the position is in it and at least half the pool is
+    // left for this search.
+    if(used > capacity / 2 || !find_root(self, other))
+    {
+        clear();
+        root = allocate(1);
+        init_node(root, pass_move);
+        root_self = self;
+        root_other = other;
+    }
+    expand(root, self, other);
+
+    MctsResult result;
+    result.reused = pool[root].visits;
+    stop = false;
+    playouts = 0;
+    std::vector<std::thread> helpers;
+    for(int i = 1; i < num_threads; i++)
+        helpers.push_back(std::thread(&MonteCarloSearch::run, this, i, time_manager,
+            playout_limit));
+    run(0, time_manager, playout_limit);
+    for(size_t i = 0; i < helpers.size(); i++)
+        helpers[i].join();
+
+    result.best_move = -1;
+    result.expected = 0.5f;
+    result.depth = 0;
+    result.playouts = playouts;
+    result.tree_nodes = used;
+
+    // Follow the most visited line; its first move is the one to play.
+    uint32_t index = root;
+    while(pool[index].state.load() == EXPANDED && pool[index].num_children)
+    {
+        const Node& node = pool[index];
+        uint32_t best = node.first_child;
+        for(uint32_t i = node.first_child + 1; i < node.first_child + node.num_children; i++)
+            if(pool[i].visits > pool[best].visits)
+                best = i;
+        if(!pool[best].visits)
+            break;
+        if(index == root)
+        {
+            if(pool[best].move != pass_move)
+                result.best_move = pool[best].move;
+            result.expected = pool[best].reward / (2.0f * pool[best].visits);
+        }
+        result.depth++;
+        index = best;
+    }
+    return result;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "time_manager.hpp"
+#include "random.hpp"
+#include <atomic>
+#include <stdint.h>
+
+/*
+ * Outcome of MonteCarloSearch::search().
+ */
+struct MctsResult
+{
+    int best_move;          // Square, or -1 to pass
+    float expected;         // Share of the points the side to move expects,
+                            // from 0 to 1, after best_move
+    int depth;              // Length of the most visited line
+    uint64_t playouts;      // Played by this search
+    uint64_t reused;        // Playouts already below the root when it started
+    uint64_t tree_nodes;    // Nodes allocated in the pool
+};
+
+/*
+ * Monte Carlo tree search: an alternative to the alpha-beta search that
+ * needs no evaluation. Each playout walks down the tree choosing children by
+ * UCT, expands the node it stops at if that has been visited before, plays
+ * the rest of the game out at random, and adds the result to every node on
+ * the way back up.
+ *
+ * Nodes come from a pool allocated once; the children of a node are a block
+ * taken from the end of it. The tree is kept between moves, so a search
+ * starts from the node of the new position if the last one expanded it and
+ * there is room left to grow; otherwise the pool is emptied.
+ *
+ * Threads share the tree without locks. Visits are counted on the way down
+ * and rewards on the way up, so a playout still in flight counts as a loss
+ * for every node on its path; this virtual loss steers other threads to
+ * other lines until it returns.
+ */
+class MonteCarloSearch {
+private:
+    enum { UNEXPANDED, EXPANDING, EXPANDED };
+
+    struct Node
+    {
+        std::atomic<uint32_t> visits;
+        std::atomic<uint32_t> reward;       // Half points for the side that moved here
+        std::atomic<uint8_t> state;
+        uint8_t move;                       // Square played to get here, or pass_move
+        uint8_t num_children;               // Valid once state is EXPANDED
+        uint32_t first_child;
+    };
+
+    Node* pool;
+    uint32_t capacity;
+    std::atomic<uint32_t> used;
+    uint32_t root;
+    uint64_t root_self;     // Discs of the side to move at the root
+    uint64_t root_other;
+    std::atomic<bool> stop;
+    std::atomic<uint64_t> playouts;
+
+    uint32_t allocate(uint32_t count);
+    void init_node(uint32_t index, int move);
+    bool expand(uint32_t index, uint64_t self, uint64_t other);
+    uint32_t select(const Node& parent);
+    bool find_root(uint64_t self, uint64_t other);
+    void iterate(Random& random);
+    void run(int id, TimeManager* time_manager, uint64_t playout_limit);
+
+public:
+    static const int pass_move = 64;
+    static const int max_path = 128;    // Moves and passes in a game, and then some
+    static const float exploration;
+
+    MonteCarloSearch(int log2_nodes);
+    ~MonteCarloSearch();
+
+    void clear();
+    MctsResult search(uint64_t self, uint64_t other, TimeManager* time_manager,
+        uint64_t playout_limit, int num_threads);
+};
@@ -0,0 +1,108 @@
+#include "move_ordering.hpp"
+#include <string.h>
+
+// Ordering scores. The hint and killer bonuses sit well above anything the
+// history table can reach between two calls of new_search().
+static const int HINT_BONUS    = 1 << 30;
+static const int KILLER_BONUS  = 1 << 28;
+static const int HISTORY_LIMIT = 1 << 24;
+
+/*
+ * Static priority of each square: corners first, then edges and the centre,
+ * with the C- and X-squares next to empty corners last.
+ */
+const int MoveOrderer::square_bonus[64] = {
+     80, -20,  20,  10,  10,  20, -20,  80,
+    -20, -40,  -5,  -5,  -5,  -5, -40, -20,
+     20,  -5,  10,   0,   0,  10,  -5,  20,
+     10,  -5,   0,   0,   0,   0,  -5,  10,
+     10,  -5,   0,   0,   0,   0,  -5,  10,
+     20,  -5,  10,   0,   0,  10,  -5,  20,
+    -20, -40,  -5,  -5,  -5,  -5, -40, -20,
+     80, -20,  20,  10,  10,  20, -20,  80
+};
+
+MoveOrderer::MoveOrderer()
+{
+    clear();
+}
+
+/*
+ * Forgets everything learned, e.g. at the start of a new game.
+ */
+void MoveOrderer::clear()
+{
+    memset(history, 0, sizeof(history));
+    new_search();
+}
+
+/*
+ * Prepares for a search from a new root. Killers are tied to plies from the
+ * old root, so they are dropped; history is halved so recent cutoffs count
+ * for more.
+ */
+void MoveOrderer::new_search()
+{
+    memset(killers, -1, sizeof(killers));
+    for(int side = 0; side < 2; side++)
+        for(int square = 0; square < 64; square++)
+            history[side][square] /= 2;
+    pv_move = -1;
+}
+
+/*
+ * Writes the squares in moves to squares, best candidate first, and returns
+ * how many there are. hint is the move to try first, or -1 for none; at the
+ * root, pv_move takes its place when set.
+ */
+int MoveOrderer::order(uint64_t moves, int hint, int ply, char side,
+    int squares[64])
+{
+    if(ply == 0 && pv_move >= 0)
+        hint = pv_move;
+
+    int side_index = side == WHITE;
+    int scores[64];
+    int n = 0;
+    while(moves)
+    {
+        int square = pop_square(moves);
+        int score = history[side_index][square] + square_bonus[square];
+        if(square == hint)
+            score += HINT_BONUS;
+        else if(ply < max_ply
+            && (square == killers[ply][0] || square == killers[ply][1]))
+            score += KILLER_BONUS;
+
+        // Insertion sort: there are rarely more than a dozen moves.
+        int i = n++;
+        for(; i > 0 && scores[i - 1] < score; i--)
+        {
+            scores[i] = scores[i - 1];
+            squares[i] = squares[i - 1];
+        }
+        scores[i] = score;
+        squares[i] = square;
+    }
+    return n;
+}
+
+/*
+ * Credits square with causing a beta cutoff at the given ply and remaining
+ * depth.
+ */
+void MoveOrderer::record_cutoff(int square, int ply, char side, int depth)
+{
+    int* side_history = history[side == WHITE];
+    side_history[square] += depth * depth;
+    if(side_history[square] > HISTORY_LIMIT)
+    {
+        for(int i = 0; i < 64; i++)
+            side_history[i] /= 2;
+    }
+    if(ply < max_ply && killers[ply][0] != square)
+    {
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = square;
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "board.hpp"
+#include "common.hpp"
+#include <stdint.h>
+
+/*
+ * Decides the order in which negamax tries moves. In order of priority:
+ * the principal-variation move (the previous iteration's best move at the
+ * root, the transposition table move elsewhere), the two killer moves that
+ * last caused a cutoff at the same ply, and then the rest by history score
+ * plus a static bonus that puts corners first and X-squares last.
+ */
+class MoveOrderer {
+public:
+    static const int max_ply = 128;
+
+private:
+    int killers[max_ply][2];
+    int history[2][64];
+    static const int square_bonus[64];
+
+public:
+    // Best move of the last completed iteration, tried first at the root.
+    int pv_move;
+
+    MoveOrderer();
+
+    void clear();
+    void new_search();
+    int order(uint64_t moves, int hint, int ply, char side, int squares[64]);
+    void record_cutoff(int square, int ply, char side, int depth);
+};
@@ -1,6 +1,24 @@
 #include "opening_book.hpp"
+#include "board.hpp"
+#include <fcntl.h>
 #include <fstream>
-#include <iostream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char OpeningBook::file_magic[8] = { 'O', 'T', 'H', 'B', 'O', 'O', 'K', 0 };
+
+/*
+ * Slot where the search for a canonical position starts.
+ */
+static inline uint64_t book_hash(uint64_t self, uint64_t other)
+{
+    uint64_t z = self ^ (other * 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
 
 void print_board(const char board[64], std::ostream& out)
 {
@@ -12,315 +30,178 @@ void print_board(const char board[64], std::ostream& out)
     }
 }
 
-std::map<std::string, Move> opening_book = {
-    // Diagonal opening
-    {
-        "        "
-        "        "
-        "        "
-        "   wb   "
-        "   bw   "
-        "        "
-        "        "
-        "        ",
-        {4, 5}
-    },
-    {
-        "        "
-        "        "
-        "  w     "
-        "  bwb   "
-        "   bw   "
-        "        "
-        "        "
-        "        ",
-        {3, 2}
-    },
-
-    // X-square opening
-    {
-        "        "
-        "        "
-        "  wb    "
-        "  bbb   "
-        "   bw   "
-        "        "
-        "        "
-        "        ",
-        {2, 4}
-    },
-    {
-        "        "
-        " b      "
-        "  bb    "
-        "  wbb   "
-        "  www   "
-        "        "
-        "        "
-        "        ",
-        {0, 0}
-    },
-
-    // Snake/Peasant
-    {
-        "        "
-        "        "
-        " bbb    "
-        "  wbb   "
-        "  www   "
-        "        "
-        "        "
-        "        ",
-        {5, 3}
-    },
-
-    // Lysons
-    {
-        "        "
-        "        "
-        " bbb w  "
-        "  wbw   "
-        "  www   "
-        "        "
-        "        "
-        "        ",
-        {2, 5}
-    },
-
-    // Pyramid/Checkerboarding Peasant
-    {
-        "        "
-        "        "
-        " bbb    "
-        " wbwbw  "
-        " bbbbb  "
-        "  bw    "
-        "        "
-        "        ",
-        {1, 5}
-    },
-
-    // Heath/Tobidashi "Jumping Out"
-    {
-        "        "
-        "        "
-        "  wb    "
-        " bbbb   "
-        "  www   "
-        "        "
-        "        "
-        "        ",
-        {3, 1}
-    },
-
-    // Classic Heath
-    {
-        "        "
-        "  bw    "
-        "  bb    "
-        " bbwb   "
-        "  www   "
-        "        "
-        "        "
-        "        ",
-        {0, 3}
-    },
-
-    // Mimura Variation II
-    {
-        "        "
-        "  bw    "
-        "  bb    "
-        " bbbbw  "
-        "  bbbb  "
-        "  wwb   "
-        "     b  "
-        "        ",
-        {5, 5}
-    },
-
-    // Heath-Bat
-    {
-        "        "
-        "   w    "
-        "  ww    "
-        " bbwb   "
-        "  bww   "
-        "   b    "
-        "        "
-        "        ",
-        {1, 2}
-    },
+OpeningBook::OpeningBook(const char* filename_in)
+    : filename(filename_in), opened(false), slots(nullptr), num_entries(0),
+      num_slots(0), mapping(nullptr), mapping_size(0)
+{
+}
 
-    // Iwasaki Varation
-    {
-        "        "
-        "   wb   "
-        "  wb    "
-        " bbwb   "
-        "  www   "
-        "        "
-        "        "
-        "        ",
-        {1, 2}
-    },
+OpeningBook::~OpeningBook()
+{
+    if(mapping)
+        munmap(mapping, mapping_size);
+}
 
-    // Heath-Chimney 'Mass-Turning'
-    {
-        "        "
-        "        "
-        "  www   "
-        " bbww   "
-        "  www   "
-        "        "
-        "        "
-        "        ",
-        {4, 2}
-    },
+/*
+ * Maps the book file. A missing or malformed file leaves the book empty, as
+ * does a table with no empty slot, where a probe for a missing position
+ * would never find the end of its chain.
+ */
+void OpeningBook::open_file()
+{
+    opened = true;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return;
+
+    struct stat info;
+    FileHeader header;
+    if(fstat(fd, &info) != 0 || read(fd, &header, sizeof(header)) != sizeof(header)
+        || memcmp(header.magic, file_magic, sizeof(file_magic)) != 0
+        || header.version != file_version
+        || header.entry_size != sizeof(BookEntry)
+        || header.num_slots == 0
+        || header.num_slots > (uint64_t) info.st_size / sizeof(BookEntry)
+        || (uint64_t) info.st_size != sizeof(header) + header.num_slots * sizeof(BookEntry))
+    {
+        close(fd);
+        return;
+    }
 
-    // Raccoon Dog
-    {
-        "        "
-        "        "
-        "  wb    "
-        "  bbb   "
-        " bwww   "
-        "        "
-        "        "
-        "        ",
-        {3, 1}
-    },
+    void* map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return;
 
-    // Rocket
+    const BookEntry* table = (const BookEntry*) ((const char*) map + sizeof(header));
+    uint64_t empty = 0;
+    while(empty < header.num_slots && (table[empty].self | table[empty].other))
+        empty++;
+    if(empty == header.num_slots)
     {
-        "        "
-        "        "
-        "  wb    "
-        "  wbb   "
-        "  bww   "
-        " b      "
-        "        "
-        "        ",
-        {4, 2}
-    },
+        munmap(map, info.st_size);
+        return;
+    }
 
-    // Hamilton
-    {
-        "        "
-        "        "
-        "  wb    "
-        "  bbb   "
-        " bwww   "
-        " bw     "
-        "        "
-        "        ",
-        {0, 5}
-    },
+    mapping = map;
+    mapping_size = info.st_size;
+    slots = table;
+    num_entries = header.num_entries;
+    num_slots = header.num_slots;
+}
 
-    // Lollipop
-    {
-        "        "
-        "        "
-        "  www   "
-        "  wbw   "
-        "  bww   "
-        " b      "
-        "        "
-        "        ",
-        {3, 5}
-    },
+/*
+ * Looks up the position with self to move. On a hit, fills in entry with the
+ * position and move in the board's own orientation and returns true.
+ */
+bool OpeningBook::probe(uint64_t self, uint64_t other, BookEntry* entry)
+{
+    if(!opened)
+        open_file();
+    if(!slots)
+        return false;
 
-    // Cow
-    {
-        "        "
-        "        "
-        "  wb    "
-        "  wbb   "
-        "  wbw   "
-        "   b    "
-        "        "
-        "        ",
-        {4, 2}
-    },
+    uint64_t canonical_self = self, canonical_other = other;
+    int which = canonicalize(&canonical_self, &canonical_other);
 
-    // Chimney
+    // The chain ends at an empty slot, and never looks at a slot twice.
+    uint64_t i = book_hash(canonical_self, canonical_other) % num_slots;
+    for(uint64_t probes = 0; probes < num_slots && (slots[i].self | slots[i].other); probes++)
     {
-        "        "
-        "        "
-        "  www   "
-        "  www   "
-        "  wbw   "
-        "   b    "
-        "        "
-        "        ",
-        {1, 4}
-    },
+        if(slots[i].self == canonical_self && slots[i].other == canonical_other)
+        {
+            *entry = slots[i];
+            entry->self = self;
+            entry->other = other;
+            entry->move = __builtin_ctzll(
+                symmetry(1ULL << slots[i].move, inverse_symmetry(which)));
+            return true;
+        }
+        if(++i == num_slots)
+            i = 0;
+    }
+    return false;
+}
 
-    // Cow Bat
-    {
-        "        "
-        "        "
-        "  wb    "
-        " bwwww  "
-        "  bbw   "
-        "   b    "
-        "        "
-        "        ",
-        {1, 5}
-    },
+uint64_t OpeningBook::size()
+{
+    if(!opened)
+        open_file();
+    return num_entries;
+}
 
-    // Perpendicular Opening
+/*
+ * Appends every position in the book, in canonical orientation, to out.
+ */
+void OpeningBook::entries(std::vector<BookEntry>* out)
+{
+    if(!opened)
+        open_file();
+    for(uint64_t i = 0; i < num_slots; i++)
     {
-        "        "
-        "        "
-        "    w   "
-        "  bbw   "
-        "   bw   "
-        "        "
-        "        "
-        "        ",
-        {5, 5}
-    },
-};
+        if(slots[i].self | slots[i].other)
+            out->push_back(slots[i]);
+    }
+}
 
-void load_book(const char* filename)
+/*
+ * Replaces the position by the smallest of its eight images, comparing self
+ * first, and returns which symmetry() took it there.
+ */
+int OpeningBook::canonicalize(uint64_t* self, uint64_t* other)
 {
-    std::ifstream input_file(filename);
-    while(input_file.good() && !input_file.eof())
+    uint64_t best_self = *self, best_other = *other;
+    int best = 0;
+    for(int which = 1; which < 8; which++)
     {
-        char board[65];
-        board[64] = '\0';
-        for(int i = 0; i < 8; i++)
+        uint64_t s = symmetry(*self, which), o = symmetry(*other, which);
+        if(s < best_self || (s == best_self && o < best_other))
         {
-            for(int j = 0; j < 8; j++)
-                board[8*i + j] = input_file.get();
-            input_file.get();
-        }
-        if(input_file.good() && !input_file.eof())
-        {
-            int x, y;
-            input_file >> x;
-            input_file.get();
-            input_file >> y;
-            input_file.get();
-            Move move(x, y);
-            std::cerr << "Assigning move (" << x << ", " << y <<") to board:\n";
-            print_board(board, std::cerr);
-            std::cerr << std::endl;
-            opening_book[board] = move;
+            best_self = s;
+            best_other = o;
+            best = which;
         }
     }
-    input_file.close();
+    *self = best_self;
+    *other = best_other;
+    return best;
 }
 
-void write_book(const char* filename)
+/*
+ * Writes a book file holding entries, which must already be canonical. The
+ * table is kept at most three quarters full so probes stay short. If a
+ * position appears twice, the later entry wins.
+ */
+bool OpeningBook::write(const char* filename, const std::vector<BookEntry>& entries)
 {
-    std::ofstream output_file(filename);
-    for(auto it = opening_book.begin(); it != opening_book.end(); ++it)
+    uint64_t table_size = entries.size() + entries.size() / 3 + 1;
+    std::vector<BookEntry> table(table_size);
+    memset(&table[0], 0, table_size * sizeof(BookEntry));
+
+    uint64_t count = 0;
+    for(size_t e = 0; e < entries.size(); e++)
     {
-        print_board(it->first.c_str(), output_file);
-        output_file << it->second.x << "," << it->second.y << "\n";
+        uint64_t i = book_hash(entries[e].self, entries[e].other) % table_size;
+        while((table[i].self | table[i].other)
+            && (table[i].self != entries[e].self || table[i].other != entries[e].other))
+        {
+            if(++i == table_size)
+                i = 0;
+        }
+        if(!(table[i].self | table[i].other))
+            count++;
+        table[i] = entries[e];
     }
-    output_file.close();
-}
 
+    FileHeader header;
+    memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version = file_version;
+    header.entry_size = sizeof(BookEntry);
+    header.num_entries = count;
+    header.num_slots = table_size;
+
+    std::ofstream out(filename, std::ios::binary);
+    out.write((const char*) &header, sizeof(header));
+    out.write((const char*) &table[0], table_size * sizeof(BookEntry));
+    return (bool) out;
+}
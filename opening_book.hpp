@@ -1,19 +1,71 @@
 #pragma once
 
 #include "common.hpp"
-#include <map>
-//#include <string.h>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
 
-/*struct CstrCmp
+/*
+ * One book position: the discs of the side to move and of its opponent, in
+ * the canonical orientation, and the move to play there. Scores and depths
+ * are filled in by the book builder; converted books leave them at zero.
+ */
+struct BookEntry
 {
-    bool operator()(const char* a, const char* b) const
+    uint64_t self;
+    uint64_t other;
+    int16_t score;      // Disc difference for the side to move
+    uint8_t move;       // Square, in the same orientation as self and other
+    uint8_t depth;      // Depth of the search that chose move
+    uint32_t reserved;
+};
+
+/*
+ * Opening book keyed on the position under all eight board symmetries. A
+ * position is stored once, as the smallest of its eight images, so a probe
+ * canonicalizes the position, finds it, and maps the move back.
+ *
+ * The book file is an open-addressed hash table of BookEntry slots behind a
+ * small header, with empty slots all zero. It is memory-mapped on the first
+ * probe, so loading costs nothing and a hit usually touches one slot.
+ */
+class OpeningBook {
+public:
+    struct FileHeader
     {
-        return (memcmp(a, b, 64) < 0);
-    }
-};*/
+        char magic[8];
+        uint32_t version;
+        uint32_t entry_size;
+        uint64_t num_entries;
+        uint64_t num_slots;
+    };
+    static const char file_magic[8];
+    static const uint32_t file_version = 1;
+
+    OpeningBook(const char* filename_in);
+    ~OpeningBook();
+
+    bool probe(uint64_t self, uint64_t other, BookEntry* entry);
+    uint64_t size();
+    void entries(std::vector<BookEntry>* out);
+
+    static int canonicalize(uint64_t* self, uint64_t* other);
+    static bool write(const char* filename, const std::vector<BookEntry>& entries);
+
+private:
+    std::string filename;
+    bool opened;
+    const BookEntry* slots;
+    uint64_t num_entries;
+    uint64_t num_slots;
+    void* mapping;
+    uint64_t mapping_size;
+
+    void open_file();
 
-extern std::map<std::string, Move> opening_book;
+    OpeningBook(const OpeningBook&);
+    OpeningBook& operator=(const OpeningBook&);
+};
 
 void print_board(const char board[64], std::ostream& out);
-void load_book(const char* filename);
-void write_book(const char* filename);
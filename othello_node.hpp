@@ -1,12 +1,48 @@
 #pragma once
 #include "board.hpp"
 #include "common.hpp"
-#include <map>
+#include <stdint.h>
 
+// How the stored score relates to the true value of the position.
+enum Bound : uint8_t
+{
+    BOUND_NONE  = 0,
+    BOUND_UPPER = 1,    // Search failed low: true score <= score
+    BOUND_LOWER = 2,    // Search failed high: true score >= score
+    BOUND_EXACT = 3
+};
+
+/*
+ * One transposition table entry. Everything but the key packs into a single
+ * 64-bit word (see pack()), which is how the table stores it. The side to
+ * move is folded into key.
+ */
 struct OthelloNode
 {
-    char move_side;
-    bool best_move_exists;
-    Move best_move;
-    int depth_checked;
+    uint64_t key;
+    int32_t score;
+    int8_t depth_checked;
+    uint8_t bound;
+    int8_t best_move;       // Square of the best move, or -1 if none
+    uint8_t age;            // Search generation that last wrote the entry
+
+    bool best_move_exists() const { return best_move >= 0; }
+
+    uint64_t pack() const
+    {
+        return (uint32_t)score
+             | (uint64_t)(uint8_t)depth_checked << 32
+             | (uint64_t)bound << 40
+             | (uint64_t)(uint8_t)best_move << 48
+             | (uint64_t)age << 56;
+    }
+
+    void unpack(uint64_t data)
+    {
+        score = (int32_t)(uint32_t)data;
+        depth_checked = (int8_t)(data >> 32);
+        bound = (uint8_t)(data >> 40);
+        best_move = (int8_t)(data >> 48);
+        age = (uint8_t)(data >> 56);
+    }
 };
@@ -0,0 +1,235 @@
+#include "pattern_eval.hpp"
+#include "board.hpp"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const int PatternEvaluator::table_size[NUM_TABLES] = {
+    59049, 19683, 59049, 6561, 6561, 6561, 6561, 2187, 729, 243, 81
+};
+
+const int PatternEvaluator::table_offset[NUM_TABLES] = {
+    0, 59049, 78732, 137781, 144342, 150903, 157464, 164025, 166212, 166941,
+    167184
+};
+
+const int PatternEvaluator::entries_per_phase = 167265;
+
+const char PatternEvaluator::file_magic[8] = { 'O', 'T', 'H', 'P', 'A', 'T', 'T', 0 };
+
+/*
+ * base3[bits] reads the low ten bits of bits as base-3 digits, so the squares
+ * of a pattern, gathered into one number for each side, become its index
+ * with one load per side. reverse8[bits] mirrors a row, for the left-right
+ * copies of a pattern.
+ */
+static constexpr int base3_digits(int bits)
+{
+    return bits ? (bits & 1) + 3 * base3_digits(bits >> 1) : 0;
+}
+
+static constexpr int reverse_bits(int b)
+{
+    return ((b & 1) << 7) | ((b & 2) << 5) | ((b & 4) << 3) | ((b & 8) << 1)
+        | ((b >> 1) & 8) | ((b >> 3) & 4) | ((b >> 5) & 2) | ((b >> 7) & 1);
+}
+
+#define B3(i)       base3_digits(i)
+#define B3_8(i)     B3(i), B3(i + 1), B3(i + 2), B3(i + 3), \
+                    B3(i + 4), B3(i + 5), B3(i + 6), B3(i + 7)
+#define B3_64(i)    B3_8(i), B3_8(i + 8), B3_8(i + 16), B3_8(i + 24), \
+                    B3_8(i + 32), B3_8(i + 40), B3_8(i + 48), B3_8(i + 56)
+#define REV(i)      reverse_bits(i)
+#define REV8(i)     REV(i), REV(i + 1), REV(i + 2), REV(i + 3), \
+                    REV(i + 4), REV(i + 5), REV(i + 6), REV(i + 7)
+#define REV64(i)    REV8(i), REV8(i + 8), REV8(i + 16), REV8(i + 24), \
+                    REV8(i + 32), REV8(i + 40), REV8(i + 48), REV8(i + 56)
+
+static const uint16_t base3[1024] = {
+    B3_64(0), B3_64(64), B3_64(128), B3_64(192),
+    B3_64(256), B3_64(320), B3_64(384), B3_64(448),
+    B3_64(512), B3_64(576), B3_64(640), B3_64(704),
+    B3_64(768), B3_64(832), B3_64(896), B3_64(960)
+};
+static const uint8_t reverse8[256] = {
+    REV64(0), REV64(64), REV64(128), REV64(192)
+};
+
+static const uint64_t MAIN_DIAGONAL = 0x8040201008040201ULL;
+static const uint64_t COLUMN_SUM    = 0x0101010101010101ULL;
+
+/*
+ * Index of a pattern given the bits of its squares for each side.
+ */
+static inline int row_index(int self_bits, int other_bits)
+{
+    return base3[self_bits] + 2 * base3[other_bits];
+}
+
+/*
+ * Bits of the diagonal that starts at square (k, 0) and runs down and to the
+ * right, as an 8 - k bit number. At most one bit per column is kept, so the
+ * multiply gathers them into the top byte without carries.
+ */
+static inline int diagonal_bits(uint64_t bits, int k)
+{
+    uint64_t mask = (MAIN_DIAGONAL << k) & (~0ULL >> (8 * k));
+    return (int) (((bits & mask) * COLUMN_SUM) >> 56) >> k;
+}
+
+/*
+ * Indices of the instances read off one orientation of the board: those
+ * along its top edge and its top-left to bottom-right diagonals.
+ */
+static inline int* orientation_indices(uint64_t self, uint64_t other,
+    bool long_diagonal, int* out)
+{
+    typedef PatternEvaluator P;
+    int s0 = self & 0xff, o0 = other & 0xff;
+    int s1 = (self >> 8) & 0xff, o1 = (other >> 8) & 0xff;
+    int s2 = (self >> 16) & 0xff, o2 = (other >> 16) & 0xff;
+    int s3 = (self >> 24) & 0xff, o3 = (other >> 24) & 0xff;
+
+    // Top edge, with the X-squares (1, 1) and (6, 1) as the top digits.
+    *out++ = P::table_offset[P::EDGE_2X]
+        + row_index(s0 | (s1 << 7 & 0x100) | (s1 << 3 & 0x200),
+            o0 | (o1 << 7 & 0x100) | (o1 << 3 & 0x200));
+
+    *out++ = P::table_offset[P::CORNER_3X3]
+        + row_index((s0 & 7) | (s1 & 7) << 3 | (s2 & 7) << 6,
+            (o0 & 7) | (o1 & 7) << 3 | (o2 & 7) << 6);
+
+    // The 2x5 block along the top edge from each corner.
+    *out++ = P::table_offset[P::CORNER_2X5]
+        + row_index((s0 & 31) | (s1 & 31) << 5, (o0 & 31) | (o1 & 31) << 5);
+    *out++ = P::table_offset[P::CORNER_2X5]
+        + row_index((reverse8[s0] & 31) | (reverse8[s1] & 31) << 5,
+            (reverse8[o0] & 31) | (reverse8[o1] & 31) << 5);
+
+    *out++ = P::table_offset[P::LINE_2] + row_index(s1, o1);
+    *out++ = P::table_offset[P::LINE_3] + row_index(s2, o2);
+    *out++ = P::table_offset[P::LINE_4] + row_index(s3, o3);
+
+    if(long_diagonal)
+        *out++ = P::table_offset[P::DIAG_8]
+            + row_index(diagonal_bits(self, 0), diagonal_bits(other, 0));
+    *out++ = P::table_offset[P::DIAG_7]
+        + row_index(diagonal_bits(self, 1), diagonal_bits(other, 1));
+    *out++ = P::table_offset[P::DIAG_6]
+        + row_index(diagonal_bits(self, 2), diagonal_bits(other, 2));
+    *out++ = P::table_offset[P::DIAG_5]
+        + row_index(diagonal_bits(self, 3), diagonal_bits(other, 3));
+    *out++ = P::table_offset[P::DIAG_4]
+        + row_index(diagonal_bits(self, 4), diagonal_bits(other, 4));
+    return out;
+}
+
+PatternEvaluator::PatternEvaluator()
+    : weights(nullptr), mapping(nullptr), mapping_size(0)
+{
+}
+
+PatternEvaluator::~PatternEvaluator()
+{
+    unload();
+}
+
+/*
+ * Maps the weight file into memory. Returns false, leaving no weights
+ * loaded, if the file is missing or is not a weight file for this layout.
+ */
+bool PatternEvaluator::load(const char* filename)
+{
+    unload();
+
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat info;
+    uint64_t expected = sizeof(FileHeader)
+        + (uint64_t) num_phases * entries_per_phase * sizeof(int16_t);
+    if(fstat(fd, &info) != 0 || (uint64_t) info.st_size != expected)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, expected, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return false;
+
+    const FileHeader* header = (const FileHeader*) map;
+    if(memcmp(header->magic, file_magic, sizeof(file_magic)) != 0
+        || header->version != file_version
+        || header->num_phases != num_phases
+        || header->entries_per_phase != (uint32_t) entries_per_phase
+        || header->disc_scale != disc_scale)
+    {
+        munmap(map, expected);
+        return false;
+    }
+
+    mapping = map;
+    mapping_size = expected;
+    weights = (const int16_t*) ((const char*) map + sizeof(FileHeader));
+    return true;
+}
+
+void PatternEvaluator::unload()
+{
+    if(mapping)
+        munmap(mapping, mapping_size);
+    mapping = nullptr;
+    mapping_size = 0;
+    weights = nullptr;
+}
+
+/*
+ * Weight set used for a position: one per ten empty squares.
+ */
+int PatternEvaluator::phase(uint64_t self, uint64_t other)
+{
+    int empties = 64 - popcount(self | other);
+    return (empties < 59 ? empties : 59) / 10;
+}
+
+/*
+ * Table entries, offsets included, for every pattern instance on the board.
+ *
+ * Rather than listing the squares of all 46 instances, the same instances
+ * are read off the board in each of its four quarter-turn orientations:
+ * rows come out whole with a shift, diagonals with one multiply, and base3[]
+ * turns each into index digits. The long diagonals are their own half-turn
+ * images, so only the first two orientations read them.
+ */
+void PatternEvaluator::indices(uint64_t self, uint64_t other,
+    int out[num_instances])
+{
+    uint64_t self_t = transpose_board(self), other_t = transpose_board(other);
+
+    out = orientation_indices(self, other, true, out);
+    out = orientation_indices(flip_board(self_t), flip_board(other_t), true, out);
+    out = orientation_indices(mirror_board(flip_board(self)),
+        mirror_board(flip_board(other)), false, out);
+    orientation_indices(mirror_board(self_t), mirror_board(other_t), false, out);
+}
+
+/*
+ * Sum of the weights of every pattern instance, in 1/disc_scale discs for
+ * self. Must only be called with weights loaded.
+ */
+int PatternEvaluator::evaluate(uint64_t self, uint64_t other) const
+{
+    int index[num_instances];
+    indices(self, other, index);
+
+    const int16_t* w = weights + phase(self, other) * entries_per_phase;
+    int total = 0;
+    for(int i = 0; i < num_instances; i++)
+        total += w[index[i]];
+    return total;
+}
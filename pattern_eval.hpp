@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Evaluation by lookup tables over groups of squares ("patterns"): edges,
+ * corner regions, and the lines and diagonals of the board. Each group of n
+ * squares is read as an n-digit base-3 number (0 empty, 1 own disc, 2 the
+ * opponent's), and the score is the sum of one table entry per pattern
+ * instance. Every symmetric copy of a pattern shares one table, and there is
+ * a separate set of tables for each game phase.
+ *
+ * The tables are trained offline by pattern_train and loaded from a binary
+ * file that is memory-mapped, so loading costs nothing up front. Scores are
+ * in 1/disc_scale of a disc, from the point of view of self.
+ */
+class PatternEvaluator {
+public:
+    enum Table
+    {
+        EDGE_2X,        // An edge plus the two X-squares next to it
+        CORNER_3X3,
+        CORNER_2X5,
+        LINE_2,         // The second, third and fourth rows in from an edge
+        LINE_3,
+        LINE_4,
+        DIAG_8,
+        DIAG_7,
+        DIAG_6,
+        DIAG_5,
+        DIAG_4,
+        NUM_TABLES
+    };
+
+    static const int num_phases = 6;
+    static const int num_instances = 46;
+    static const int disc_scale = 32;
+    static const int table_size[NUM_TABLES];
+    static const int table_offset[NUM_TABLES];
+    static const int entries_per_phase;
+
+    /*
+     * Layout of the weight file: this header, then num_phases blocks of
+     * entries_per_phase little-endian int16_t weights, each block holding
+     * the tables in Table order.
+     */
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t num_phases;
+        uint32_t entries_per_phase;
+        uint32_t disc_scale;
+    };
+    static const char file_magic[8];
+    static const uint32_t file_version = 1;
+
+    PatternEvaluator();
+    ~PatternEvaluator();
+
+    bool load(const char* filename);
+    void unload();
+    bool loaded() const { return weights != nullptr; }
+
+    int evaluate(uint64_t self, uint64_t other) const;
+
+    static int phase(uint64_t self, uint64_t other);
+    static void indices(uint64_t self, uint64_t other, int out[num_instances]);
+
+private:
+    const int16_t* weights;
+    void* mapping;
+    uint64_t mapping_size;
+
+    PatternEvaluator(const PatternEvaluator&);
+    PatternEvaluator& operator=(const PatternEvaluator&);
+};
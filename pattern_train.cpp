@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "endgame.hpp"
+#include "pattern_eval.hpp"
+#include "player.hpp"
+#include "random.hpp"
+using namespace std;
+
+// Offline training for PatternEvaluator.
+//
+//   pattern_train generate games out_file [seed]
+//       Plays games from randomised openings and writes every position with
+//       the final disc difference from the mover's point of view. The last
+//       solve_empties plies are played perfectly by the endgame solver, so
+//       from there on every label is exact.
+//
+//   pattern_train fit data_file weight_file [epochs]
+//       Fits the pattern tables of each phase to the labels by stochastic
+//       gradient descent and writes a weight file for PatternEvaluator::load.
+//
+// Positions are written as "board side score", with the board in the same
+// 64-character form the bench suite uses.
+
+static const int solve_empties = 14;
+static const int search_depth = 4;
+static const double random_move_rate = 0.1;
+static const float learning_rate = 0.2f;    // Per sample, spread over all instances
+
+struct Sample {
+    uint64_t self, other;
+    float score;
+};
+
+static void write_position(ostream& out, const Board& board, char side, int score)
+{
+    for (int i = 0; i < 64; i++)
+        out << ((board.black >> i & 1) ? 'b' : (board.white >> i & 1) ? 'w' : '-');
+    out << ' ' << side << ' ' << score << '\n';
+}
+
+template <class T>
+static void shuffle_range(T first, T last, Random& rng)
+{
+    for (T i = last; i - first > 1; --i)
+        swap(*(i - 1), *(first + rng() % (i - first)));
+}
+
+static int random_move(uint64_t moves, Random& rng)
+{
+    int n = rng() % popcount(moves);
+    while (n--) pop_square(moves);
+    return pop_square(moves);
+}
+
+static int generate(int games, const char* filename, uint64_t seed)
+{
+    ofstream out(filename);
+    if (!out) {
+        cerr << "cannot open " << filename << endl;
+        return 1;
+    }
+
+    Random rng(seed);
+    Player player(BLACK, 1);
+    TranspositionTable transpositions(20);
+    EndgameSolver solver(&transpositions);
+
+    for (int game = 0; game < games; game++) {
+        Board board;
+        char side = BLACK;
+        int random_plies = 8 + rng() % 12;
+        int ply = 0;
+        vector<pair<Board, char> > history;
+        int final_black = 0;
+
+        player.new_game();
+        while (true) {
+            uint64_t moves = board.getMoves(side);
+            if (!moves) {
+                if (!board.getMoves(OTHER_SIDE(side))) {
+                    final_black = popcount(board.black) - popcount(board.white);
+                    break;
+                }
+                side = OTHER_SIDE(side);
+                continue;
+            }
+
+            // From here on the solver plays and the result is known exactly.
+            if (popcount(board.empties()) <= solve_empties) {
+                int square;
+                int score = solver.solve_root(&board, side, &square);
+                final_black = side == BLACK ? score : -score;
+                break;
+            }
+
+            history.push_back(make_pair(board, side));
+            int square;
+            if (ply < random_plies || rng() % 1000 < random_move_rate * 1000)
+                square = random_move(moves, rng);
+            else
+                square = player.search(&board, side, search_depth, -1).best_move;
+            UndoRecord undo;
+            board.makeMove(square, side, &undo);
+            side = OTHER_SIDE(side);
+            ply++;
+        }
+
+        for (size_t i = 0; i < history.size(); i++)
+            write_position(out, history[i].first, history[i].second,
+                history[i].second == BLACK ? final_black : -final_black);
+
+        // Play out the solved part too, labelling each position exactly.
+        while (popcount(board.empties()) <= solve_empties) {
+            uint64_t moves = board.getMoves(side);
+            if (!moves) {
+                if (!board.getMoves(OTHER_SIDE(side))) break;
+                side = OTHER_SIDE(side);
+                continue;
+            }
+            int square;
+            int score = solver.solve_root(&board, side, &square);
+            write_position(out, board, side, score);
+            UndoRecord undo;
+            board.makeMove(square, side, &undo);
+            side = OTHER_SIDE(side);
+        }
+
+        if ((game + 1) % 100 == 0) cerr << "games: " << game + 1 << endl;
+    }
+    return 0;
+}
+
+static bool read_samples(const char* filename, vector<Sample> samples[])
+{
+    ifstream input(filename);
+    if (!input) {
+        cerr << "cannot open " << filename << endl;
+        return false;
+    }
+
+    string line;
+    while (getline(input, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream fields(line);
+        string board_str, side_str;
+        int score;
+        if (!(fields >> board_str >> side_str >> score) || board_str.size() != 64) {
+            cerr << "bad line: " << line << endl;
+            return false;
+        }
+
+        uint64_t black = 0, white = 0;
+        for (int i = 0; i < 64; i++) {
+            if (board_str[i] == BLACK) black |= 1ULL << i;
+            else if (board_str[i] == WHITE) white |= 1ULL << i;
+        }
+        Sample sample;
+        sample.self = side_str[0] == WHITE ? white : black;
+        sample.other = side_str[0] == WHITE ? black : white;
+        sample.score = score;
+        samples[PatternEvaluator::phase(sample.self, sample.other)].push_back(sample);
+    }
+    return true;
+}
+
+static int fit(const char* data_file, const char* weight_file, int epochs)
+{
+    vector<Sample> samples[PatternEvaluator::num_phases];
+    if (!read_samples(data_file, samples)) return 1;
+
+    const int entries = PatternEvaluator::entries_per_phase;
+    vector<float> weights((size_t) PatternEvaluator::num_phases * entries, 0.0f);
+    Random rng(1);
+
+    for (int phase = 0; phase < PatternEvaluator::num_phases; phase++) {
+        vector<Sample>& set = samples[phase];
+        float* w = &weights[(size_t) phase * entries];
+        if (set.empty()) continue;
+
+        // Hold back a tenth of the positions to report the fit honestly.
+        shuffle_range(set.begin(), set.end(), rng);
+        size_t held_out = set.size() / 10;
+        int index[PatternEvaluator::num_instances];
+        float rate = learning_rate / PatternEvaluator::num_instances;
+
+        for (int epoch = 0; epoch < epochs; epoch++) {
+            shuffle_range(set.begin() + held_out, set.end(), rng);
+            for (size_t i = held_out; i < set.size(); i++) {
+                PatternEvaluator::indices(set[i].self, set[i].other, index);
+                float predicted = 0;
+                for (int j = 0; j < PatternEvaluator::num_instances; j++)
+                    predicted += w[index[j]];
+                float step = rate * (set[i].score - predicted);
+                for (int j = 0; j < PatternEvaluator::num_instances; j++)
+                    w[index[j]] += step;
+            }
+            rate *= 0.8f;
+        }
+
+        double error = 0, baseline = 0;
+        for (size_t i = 0; i < held_out; i++) {
+            baseline += max(set[i].score, -set[i].score);
+            PatternEvaluator::indices(set[i].self, set[i].other, index);
+            float predicted = 0;
+            for (int j = 0; j < PatternEvaluator::num_instances; j++)
+                predicted += w[index[j]];
+            error += max(set[i].score - predicted, predicted - set[i].score);
+        }
+        fprintf(stderr, "phase %d: %zu positions, held-out mean error %.2f discs"
+            " (%.2f guessing a draw)\n", phase, set.size(),
+            held_out ? error / held_out : 0.0, held_out ? baseline / held_out : 0.0);
+    }
+
+    PatternEvaluator::FileHeader header;
+    memcpy(header.magic, PatternEvaluator::file_magic, sizeof(header.magic));
+    header.version = PatternEvaluator::file_version;
+    header.num_phases = PatternEvaluator::num_phases;
+    header.entries_per_phase = entries;
+    header.disc_scale = PatternEvaluator::disc_scale;
+
+    vector<int16_t> packed(weights.size());
+    for (size_t i = 0; i < weights.size(); i++) {
+        float scaled = weights[i] * PatternEvaluator::disc_scale;
+        scaled = max(-32767.0f, min(32767.0f, scaled));
+        packed[i] = (int16_t) (scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+    }
+
+    ofstream out(weight_file, ios::binary);
+    out.write((const char*) &header, sizeof(header));
+    out.write((const char*) &packed[0], packed.size() * sizeof(int16_t));
+    if (!out) {
+        cerr << "cannot write " << weight_file << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 4 && !strcmp(argv[1], "generate"))
+        return generate(atoi(argv[2]), argv[3], argc > 4 ? strtoull(argv[4], nullptr, 10) : 1);
+    if (argc >= 4 && !strcmp(argv[1], "fit"))
+        return fit(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 10);
+
+    cerr << "usage: " << argv[0] << " generate games out_file [seed]" << endl
+         << "       " << argv[0] << " fit data_file weight_file [epochs]" << endl;
+    return -1;
+}
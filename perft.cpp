@@ -0,0 +1,105 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "board.hpp"
+using namespace std;
+
+// Published leaf counts from the standard starting position, with a pass
+// taking up a ply and a finished game counting as one leaf.
+static const uint64_t known_counts[] = {
+    1ULL, 4ULL, 12ULL, 56ULL, 244ULL, 1396ULL, 8200ULL, 55092ULL,
+    390216ULL, 3005288ULL, 24571284ULL, 212258800ULL, 1939886636ULL,
+    18429641748ULL, 184042084512ULL
+};
+static const int num_known_counts = sizeof(known_counts) / sizeof(known_counts[0]);
+
+static bool bulk = false;
+
+/*
+ * Counts the leaves of the game tree below board, depth plies deep. With
+ * bulk counting, the last ply is counted from the move mask instead of being
+ * played out.
+ */
+static uint64_t perft(Board* board, char side, int depth, bool passed)
+{
+    if (depth == 0) return 1;
+
+    uint64_t moves = board->getMoves(side);
+    if (!moves) {
+        if (passed) return 1;   // Neither side can move: the game is over
+        return perft(board, OTHER_SIDE(side), depth - 1, true);
+    }
+    if (bulk && depth == 1) return popcount(moves);
+
+    uint64_t leaves = 0;
+    while (moves) {
+        UndoRecord undo;
+        board->makeMove(pop_square(moves), side, &undo);
+        leaves += perft(board, OTHER_SIDE(side), depth - 1, false);
+        board->unmakeMove(undo);
+    }
+    return leaves;
+}
+
+int main(int argc, char *argv[]) {
+    // perft depth [board side] [--bulk] [--kernel NAME]
+    int nargs = 0;
+    char *args[3];
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--bulk")) bulk = true;
+        else if (!strcmp(argv[i], "--kernel") && i + 1 < argc) {
+            if (!Board::set_kernel(argv[++i])) {
+                fprintf(stderr, "kernel %s is unknown or not supported here\n", argv[i]);
+                exit(-1);
+            }
+        }
+        else if (nargs < 3) args[nargs++] = argv[i];
+    }
+    if (nargs != 1 && nargs != 3) {
+        fprintf(stderr, "usage: %s depth [board side] [--bulk] [--kernel portable|bmi2|avx2]\n",
+            argv[0]);
+        fprintf(stderr, "  board: 64 characters in print_board order, 'b', 'w' and ' ' or '-'\n");
+        fprintf(stderr, "  side:  b or w, the side to move\n");
+        exit(-1);
+    }
+
+    int max_depth = atoi(args[0]);
+    Board board;
+    char side = BLACK;
+    bool start_position = true;
+    if (nargs == 3) {
+        if (strlen(args[1]) != 64) {
+            fprintf(stderr, "board must be 64 characters\n");
+            exit(-1);
+        }
+        char data[64];
+        for (int i = 0; i < 64; i++)
+            data[i] = args[1][i] == '-' ? ' ' : args[1][i];
+        board.setBoard(data);
+        side = args[2][0] == WHITE ? WHITE : BLACK;
+        start_position = false;
+    }
+
+    bool all_match = true;
+    printf("kernel %s\n", Board::kernel_name());
+    printf("depth %14s %10s %10s\n", "leaves", "ms", "Mnps");
+    for (int depth = 1; depth <= max_depth; depth++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        uint64_t leaves = perft(&board, side, depth, false);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        printf("%5d %14llu %10.1f %10.2f", depth, (unsigned long long) leaves,
+            seconds * 1000, seconds > 0 ? leaves / seconds / 1e6 : 0.0);
+        if (start_position && depth < num_known_counts) {
+            bool match = leaves == known_counts[depth];
+            all_match = all_match && match;
+            printf(match ? "  ok" : "  MISMATCH (expected %llu)",
+                (unsigned long long) known_counts[depth]);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    return all_match ? 0 : 1;
+}
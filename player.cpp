@@ -1,69 +1,223 @@
 #include "player.hpp"
 #include "opening_book.hpp"
+#include "evaluate.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <map>
 #include <limits>
+#include <mutex>
+#include <sstream>
 #include <vector>
 #include <thread>
-#include <time.h>
-
-const int Player::weights[8][8] = 
-   {{  5, -3,  2,  2,  2,  2, -3,  5 },
-    { -3, -5, -1, -1, -1, -1, -5, -3 },
-    {  2, -1,  1,  0,  0,  1, -1,  2 },
-    {  2, -1,  0,  1,  1,  0, -1,  2 },
-    {  2, -1,  0,  1,  1,  0, -1,  2 },
-    {  2, -1,  1,  0,  0,  1, -1,  2 },
-    { -3, -5, -1, -1, -1, -1, -5, -3 },
-    {  5, -3,  2,  2,  2,  2, -3,  5 }};
 
 const int Player::max_depth = 100;
 const int Player::default_depth = 5;
+const char* const Player::pattern_file = "presbyterian_ghostbusters_patterns";
+const char* const Player::book_file = "presbyterian_ghostbusters_book";
+const char* const Player::probcut_file = "presbyterian_ghostbusters_probcut";
+const float Player::default_probcut_confidence = 1.0f;
+const int Player::tt_log2_entries = 21;    // 32 MB
+const int Player::default_endgame_empties = 20;
+const int Player::aspiration_depth = 4;
+const int Player::aspiration_window = 64;
+const int Player::mcts_log2_nodes = 22;     // 64 MB
+const uint64_t Player::default_playouts = 20000;
+/*
+ * The book, pattern weights and ProbCut parameters never change once read,
+ * so every Player in the process shares one copy, loaded by the first one
+ * constructed. The book is mapped here, as a first probe from two threads
+ * at once would race to map it.
+ */
+struct SharedData
+{
+    OpeningBook book;
+    PatternEvaluator patterns;
+    ProbCut probcut;
+
+    SharedData()
+        : book(Player::book_file)
+    {
+        book.size();
+        patterns.load(Player::pattern_file);
+        probcut.load(Player::probcut_file);
+    }
+};
+
+static SharedData& shared_data()
+{
+    static SharedData data;
+    return data;
+}
+
 /*
  * Constructor for the player; initialize everything here. The side your AI is
  * on (BLACK or WHITE) is passed in as "side". The constructor must finish
- * within 30 seconds.
+ * within 30 seconds. num_threads is the number of search threads, or 0 for
+ * one per hardware thread, engine_in chooses between alpha-beta and
+ * Monte Carlo tree search, and the transposition table has 2^tt_log2
+ * entries.
  */
-Player::Player(char player_side_in)
+Player::Player(char player_side_in, int num_threads, SearchEngine engine_in, int tt_log2)
     : board(new Board()),
-      erm(30),
+      transpositions(tt_log2),
+      book(shared_data().book),
+      stop_search(false),
+      clock_started(false),
+      endgame_empties(default_endgame_empties),
+      fixed_depth(default_depth),
+      node_limit(0),
+      moves_played(0),
+      stats_out(&std::cerr),
+      patterns(shared_data().patterns),
+      evaluation(EVAL_SQUARES),
+      probcut(shared_data().probcut),
+      probcut_confidence(default_probcut_confidence),
+      use_probcut(false),
       player_side(player_side_in),
+      engine(engine_in),
+      mcts(engine_in == ENGINE_MCTS ? new MonteCarloSearch(mcts_log2_nodes) : nullptr),
+      ponder_enabled(false),
+      ponder_side(player_side_in),
+      ponder_move(-2),
+      ponder_depth(0),
+      ponder_source(nullptr),
       testingMinimax(false)   // Will be set to true in test_minimax.cpp.
 {
-    /*char test[] = "abcdefgh"
-                  "ijklmnop"
-                  "qrstuvwx"
-                  "yz012345"
-                  "01234567"
-                  "01234567"
-                  "01234567"
-                  "01234567";
+    set_threads(num_threads);
 
-    Move move(4, 6);
+    if(patterns.loaded())
+        evaluation = EVAL_PATTERNS;
+    else
+        std::cerr << "No pattern weights in " << pattern_file
+            << ", evaluating by square weights\n";
+}
 
-    for(int j = 0; j < 64; j++)
-    {
-        if(j % 8 == 0)
-            std::cerr << "\n";
-        std::cerr << test[j];
-    }
-    std::cerr << "\tMove:" << move.x << ", " << move.y << std::endl;
-    char rotated[64];
-    for(int i = 0; i < 4; i++)
+static const char* const evaluation_names[] = { "squares", "patterns", "features" };
+
+const char* evaluation_name(Evaluation evaluation)
+{
+    return evaluation_names[evaluation];
+}
+
+/*
+ * Sets evaluation to the one evaluation_name() calls name and returns true,
+ * or returns false if there is none.
+ */
+bool parse_evaluation(const char* name, Evaluation* evaluation)
+{
+    for(int i = 0; i < 3; i++)
     {
-        rotate_data(test, rotated);
-        move = rotate_move(move, 1);
-        memcpy(test, rotated, 64);
-        for(int j = 0; j < 64; j++)
+        if(!strcmp(name, evaluation_names[i]))
         {
-            if(j % 8 == 0)
-                std::cerr << "\n";
-            std::cerr << test[j];
+            *evaluation = (Evaluation) i;
+            return true;
         }
-        std::cerr << "\tMove:" << move.x << ", " << move.y << std::endl;
-    }*/
-    //std::this_thread::sleep_for(std::chrono::seconds(10));
+    }
+    return false;
+}
 
-    //load_book("presbyterian_ghostbusters_moves");
+/*
+ * Sets how many threads search each move, or one per hardware thread if
+ * num_threads is 0.
+ */
+void Player::set_threads(int num_threads)
+{
+    stop_ponder();
+    if(num_threads <= 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    threads.resize(num_threads);
+    for(int i = 0; i < num_threads; i++)
+    {
+        threads[i].id = i;
+        threads[i].counters.clear();
+    }
+}
+
+/*
+ * Sets the number of empty squares at which the exact endgame solver takes
+ * over from the heuristic search. 0 turns the solver off.
+ */
+void Player::set_endgame_empties(int empties)
+{
+    endgame_empties = empties;
+}
+
+/*
+ * Sets how deep doMove() searches when it is given no time limit.
+ */
+void Player::set_depth(int depth)
+{
+    fixed_depth = depth;
+}
+
+/*
+ * Ends each heuristic search once the main thread has visited about this
+ * many nodes, 0 for no limit; for MCTS, after this many playouts. Endgame
+ * solves are not limited.
+ */
+void Player::set_node_limit(uint64_t nodes)
+{
+    node_limit = nodes;
+}
+
+/*
+ * Gives every search and solve a fixed ms milliseconds in place of a share
+ * of the game clock, 0 to go back to the clock.
+ */
+void Player::set_move_time(int ms)
+{
+    time_manager.set_move_time(ms);
+}
+
+/*
+ * Sets how sure Multi-ProbCut must be, in standard deviations of its
+ * prediction, before it cuts a node; 0 turns it off. It only runs when the
+ * loaded parameters were calibrated for the evaluation in use.
+ */
+void Player::set_probcut_confidence(float confidence)
+{
+    probcut_confidence = confidence;
+}
+
+/*
+ * Chooses the leaf evaluation. Patterns can only be chosen if their weights
+ * were loaded; returns whether the evaluation changed to the one asked for.
+ */
+bool Player::set_evaluation(Evaluation evaluation_in)
+{
+    if(evaluation_in == EVAL_PATTERNS && !patterns.loaded())
+        return false;
+    evaluation = evaluation_in;
+    return true;
+}
+
+/*
+ * Sends the per-move statistics to the named file instead of stderr.
+ */
+void Player::set_stats_file(const char* filename)
+{
+    stats_file.open(filename, std::ios::app);
+    stats_out = stats_file ? &stats_file : &std::cerr;
+}
+
+/*
+ * Names the game in each line of statistics, for a file that several games
+ * write to at once.
+ */
+void Player::set_game_id(const std::string& id)
+{
+    game_id = id;
+}
+
+/*
+ * Turns searching on the opponent's time on or off.
+ */
+void Player::set_ponder(bool enabled)
+{
+    if(!enabled)
+        stop_ponder();
+    ponder_enabled = enabled;
 }
 
 /*
@@ -71,6 +225,8 @@ Player::Player(char player_side_in)
  */
 Player::~Player()
 {
+    stop_ponder();
+    delete mcts;
     delete board;
 }
 
@@ -79,113 +235,628 @@ Player::~Player()
  */
 void Player::set_board(Board* board_in)
 {
+    stop_ponder();
     delete board;
     board = board_in;
 }
 
-void Player::get_possible_moves(Board* board, char side, std::vector<Move>* moves)
+/*
+ * Leaf evaluations as policies for negamax(), which is compiled once for
+ * each so that no leaf has to ask which one is in use.
+ */
+struct DiscCountPolicy
 {
-    *moves = { };
-    for(int i = 0; i < 8; i++)
+    static int evaluate(const PatternEvaluator&, uint64_t self, uint64_t other)
     {
-        for(int j = 0; j < 8; j++)
-        {
-            Move move(i, j);
-            if(board->checkMove(&move, side))
-                moves->push_back(move);
-        }
+        return popcount(self) - popcount(other);
     }
-}
+};
+
+struct SquareWeightPolicy
+{
+    static int evaluate(const PatternEvaluator&, uint64_t self, uint64_t other)
+    {
+        return weighted_square_sum(self, other);
+    }
+};
 
-int Player::negamax(Board* board, int depth, char move_side, int a, int b, Move** m)
+struct PatternPolicy
 {
-    int best_score = -INFINITY;
-    // Check if exists in transposition table
+    static int evaluate(const PatternEvaluator& patterns, uint64_t self, uint64_t other)
+    {
+        return patterns.evaluate(self, other);
+    }
+};
+
+struct FeaturePolicy
+{
+    static int evaluate(const PatternEvaluator&, uint64_t self, uint64_t other)
+    {
+        return feature_evaluation(self, other);
+    }
+};
+
+/*
+ * Negamax with alpha-beta on thread's board, for side to move, compiled for
+ * each leaf evaluation, node type and side. The root returns its best move
+ * through m; other nodes take none.
+ */
+template<class Eval, NodeType type, char side>
+int Player::negamax(SearchThread* thread, int depth, int ply, int a, int b, Move** m)
+{
+    const char other_side = OTHER_SIDE(side);
+    const NodeType child_type = type == NODE_SCOUT ? NODE_SCOUT : NODE_PV;
+    Board* board = &thread->board;
+    int best_score = -SCORE_INFINITY;
+
+    // Every so often the main thread checks the clock and the node limit and
+    // stops the whole search once either has run out. Helpers are also
+    // stopped as soon as the main thread is done.
+    if((++thread->counters.nodes & 1023) == 0 && thread->id == 0
+        && (time_manager.hard_expired()
+            || (node_limit && thread->counters.nodes >= node_limit)))
+        stop_search = true;
+    if(stop_search.load(std::memory_order_relaxed))
+        return 0;
 
     // If passing move, start out with nullptr
-    if(m)
+    if(type == NODE_ROOT)
         *m = nullptr;
 
+    uint64_t self = board->pieces(side);
+    uint64_t other = board->pieces(other_side);
+
     // If reached bottom, return heuristic of this state
     if(depth == 0)
-        return heuristic(board, move_side);
+    {
+        thread->counters.leaves++;
+        return Eval::evaluate(patterns, self, other);
+    }
+
+    // Check if exists in transposition table. A deep enough entry can end the
+    // search here, except at the root where a move must be produced.
+    int original_a = a;
+    int tt_move = -1;
+    uint64_t key = board->hash(side);
+    OthelloNode node;
+    thread->counters.tt_probes++;
+    if(transpositions.probe(key, &node))
+    {
+        thread->counters.tt_hits++;
+        tt_move = node.best_move;
+        if(type != NODE_ROOT && node.depth_checked >= depth)
+        {
+            if(node.bound == BOUND_EXACT
+                || (node.bound == BOUND_LOWER && node.score >= b)
+                || (node.bound == BOUND_UPPER && node.score <= a))
+                return node.score;
+        }
+    }
 
-    char other_side = OTHER_SIDE(move_side);
-    std::vector<Move> moves;
-    get_possible_moves(board, move_side, &moves);
+    uint64_t moves = find_moves(self, other);
+    int best_square = -1;
 
     // If no moves available for this side
-    if(moves.empty())
+    if(!moves)
     {
-        std::vector<Move> other_moves;
-        get_possible_moves(board, other_side, &other_moves);
-        if(other_moves.empty())   // Game endpoint
+        if(!find_moves(other, self))   // Game endpoint
         {
-            int diff = board->count(move_side) - board->count(other_side);
+            int diff = popcount(self) - popcount(other);
             if(diff > 0)
-                best_score = INFINITY / 2;    // Win is infinitely valuable, but
+                best_score = SCORE_INFINITY / 2;    // Win is infinitely valuable, but
                                         // must divide by 2 for maximizing
             else if(diff < 0)
-                best_score = -INFINITY / 2;   // Loss is infinitely bad, but
+                best_score = -SCORE_INFINITY / 2;   // Loss is infinitely bad, but
                                         // must divide by 2 for maximizing
             else
                 best_score = 0;           // Draw is neutral
         }
         else
             best_score = -20;             // We don't want to pass a move
+        transpositions.store(key, depth, best_score, BOUND_EXACT, -1);
+        thread->counters.tt_stores++;
+        return best_score;
     }
-    else
+
+    // Multi-ProbCut: if a shallow search says the deep one is almost sure to
+    // fail high, or low, take that as the result. Each test is a null-window
+    // search at the shallow score that predicts the window's edge plus the
+    // margin of error.
+    const ProbCutParams* cut = type != NODE_ROOT && use_probcut
+        ? probcut.find(depth, popcount(board->empties())) : nullptr;
+    if(cut)
     {
-        Move best_move(0, 0);
-        for(auto it = moves.begin(); it != moves.end(); ++it)
+        float margin = probcut_confidence * cut->sigma;
+        if(b < SCORE_INFINITY / 4)
         {
-            Board copy = *board;
-            copy.doMove(&*it, move_side);
-            int this_score = -negamax(&copy, depth - 1, other_side, -b, -a);
-            if(this_score > best_score)
+            int bound = (int) ((b + margin - cut->intercept) / cut->slope) + 1;
+            if(negamax<Eval, NODE_SCOUT, side>(thread, cut->shallow_depth, ply,
+                    bound - 1, bound) >= bound)
             {
-                best_score = this_score;
-                best_move = *it;
-                a = this_score;
+                thread->counters.probcuts++;
+                return b;
+            }
+        }
+        if(a > -SCORE_INFINITY / 4 && !stop_search.load(std::memory_order_relaxed))
+        {
+            int bound = (int) ((a - margin - cut->intercept) / cut->slope) - 1;
+            if(negamax<Eval, NODE_SCOUT, side>(thread, cut->shallow_depth, ply,
+                    bound, bound + 1) <= bound)
+            {
+                thread->counters.probcuts++;
+                return a;
+            }
+        }
+        if(stop_search.load(std::memory_order_relaxed))
+            return 0;
+    }
+
+    // Principal variation search: the first move gets the full window, and
+    // the rest a null window that only asks whether they beat it. The few
+    // that do are searched again with the full window for their score. A
+    // scout node's window is already null, so it never searches again.
+    int squares[64];
+    int n = thread->move_orderer.order(moves, tt_move, ply, side, squares);
+
+    // Each helper starts the root on a different move, so that the helpers
+    // fill the table with other lines than the main thread's.
+    if(ply == 0 && thread->id > 0)
+        std::rotate(squares, squares + thread->id % n, squares + n);
+    for(int i = 0; i < n; i++)
+    {
+        int square = squares[i];
+        bool scout_beat_a = false;
+        UndoRecord undo;
+        board->makeMove(square, side, &undo);
+        int this_score;
+        if(i == 0)
+            this_score = -negamax<Eval, child_type, other_side>(thread, depth - 1, ply + 1, -b, -a);
+        else
+        {
+            this_score = -negamax<Eval, NODE_SCOUT, other_side>(thread, depth - 1, ply + 1,
+                -a - 1, -a);
+            if(type != NODE_SCOUT && this_score > a && this_score < b
+                && !stop_search.load(std::memory_order_relaxed))
+            {
+                scout_beat_a = true;
+                thread->counters.researches++;
+                this_score = -negamax<Eval, NODE_PV, other_side>(thread, depth - 1, ply + 1,
+                    -b, -a);
+            }
+        }
+        board->unmakeMove(undo);
+
+        // An aborted child's score means nothing. At the root, the moves
+        // searched so far are still good: the first was the previous
+        // iteration's best, and any that beat it did so at the new depth,
+        // even if only the scout finished.
+        if(stop_search.load(std::memory_order_relaxed))
+        {
+            if(type == NODE_ROOT && scout_beat_a)
+                best_square = square;
+            if(type == NODE_ROOT && best_square >= 0)
+                *m = new Move(best_square % 8, best_square / 8);
+            return best_score;
+        }
+        if(this_score > best_score)
+        {
+            best_score = this_score;
+            best_square = square;
+            if(best_score > a)
+            {
+                a = best_score;
                 if(a >= b)  // Prune branch
+                {
+                    thread->move_orderer.record_cutoff(square, ply, side, depth);
+                    thread->counters.cutoffs++;
+                    thread->counters.first_move_cutoffs += i == 0;
                     break;
+                }
             }
         }
-
-        if(m)
-            *m = new Move(best_move);
     }
+
+    int bound = best_score <= original_a ? BOUND_UPPER
+              : best_score >= b ? BOUND_LOWER : BOUND_EXACT;
+    transpositions.store(key, depth, best_score, bound, best_square);
+    thread->counters.tt_stores++;
+
+    if(type == NODE_ROOT)
+        *m = new Move(best_square % 8, best_square / 8);
     return best_score;
 }
 
-/**
- * @brief Returns a weighted sum of all heuristics.
+/*
+ * Picks the compiled negamax for side and the root's node type. Helpers
+ * want no move, so they search the root as a PV node.
  */
-int Player::heuristic(Board* board, char move_side)
+template<class Eval>
+int Player::negamax_root(SearchThread* thread, int depth, char side, int a, int b, Move** m)
+{
+    if(side == BLACK)
+        return m ? negamax<Eval, NODE_ROOT, BLACK>(thread, depth, 0, a, b, m)
+                 : negamax<Eval, NODE_PV, BLACK>(thread, depth, 0, a, b);
+    return m ? negamax<Eval, NODE_ROOT, WHITE>(thread, depth, 0, a, b, m)
+             : negamax<Eval, NODE_PV, WHITE>(thread, depth, 0, a, b);
+}
+
+/*
+ * Searches thread's board to depth for side in the window (a, b), with the
+ * negamax compiled for the evaluation in use, and returns the score. If m
+ * is given, the best move is returned through it.
+ */
+int Player::negamax_root(SearchThread* thread, int depth, char side, int a, int b, Move** m)
 {
-    char other_side = OTHER_SIDE(move_side);
     if(testingMinimax)
-        return board->count(move_side) - board->count(other_side);
-    else
+        return negamax_root<DiscCountPolicy>(thread, depth, side, a, b, m);
+    if(evaluation == EVAL_PATTERNS)
+        return negamax_root<PatternPolicy>(thread, depth, side, a, b, m);
+    if(evaluation == EVAL_FEATURES)
+        return negamax_root<FeaturePolicy>(thread, depth, side, a, b, m);
+    return negamax_root<SquareWeightPolicy>(thread, depth, side, a, b, m);
+}
+
+/*
+ * Resets the per-search state of every thread and starts the clock.
+ */
+void Player::begin_search(Board* position, int ms_left)
+{
+    time_manager.start(ms_left, popcount(position->empties()), endgame_empties);
+    clock_started = true;
+    stop_search = false;
+    use_probcut = probcut_confidence > 0 && !testingMinimax && probcut.loaded()
+        && probcut.evaluation() == evaluation_name(evaluation);
+    transpositions.new_search();
+    for(size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].board = *position;
+        threads[i].move_orderer.new_search();
+        threads[i].counters.clear();
+    }
+}
+
+/*
+ * Starts the Lazy SMP helper threads on their copies of the position. They
+ * share nothing with the main search but the transposition table, which they
+ * fill with results the main thread then finds on its way down.
+ */
+void Player::start_helpers(char side)
+{
+    for(size_t i = 1; i < threads.size(); i++)
+        helpers.push_back(std::thread(&Player::helper_search, this, &threads[i], side));
+}
+
+/*
+ * Stops the helper threads and waits for them to exit, so none outlive the
+ * call to doMove().
+ */
+void Player::stop_helpers()
+{
+    stop_search = true;
+    for(size_t i = 0; i < helpers.size(); i++)
+        helpers[i].join();
+    helpers.clear();
+}
+
+/*
+ * Iterative deepening loop of one helper thread. Odd-numbered helpers run a
+ * ply ahead of the others so the threads spread out over two depths, and
+ * each helper starts the root on a move of its own (see negamax()).
+ */
+void Player::helper_search(SearchThread* thread, char side)
+{
+    for(int depth = 1 + thread->id % 2; depth <= max_depth
+        && !stop_search.load(std::memory_order_relaxed); depth++)
+    {
+        negamax_root(thread, depth, side, -SCORE_INFINITY, SCORE_INFINITY);
+    }
+}
+
+/*
+ * Searches position for side by iterative deepening with the heuristic, up
+ * to depth_limit or until the time manager calls a halt. ms_left is the time
+ * left for the game, or -1 for no limit.
+ */
+SearchResult Player::search(Board* position, char side, int depth_limit, int ms_left)
+{
+    SearchResult result = { -1, 0, 0, false, 0, 0 };
+    begin_search(position, ms_left);
+    SearchThread* main_thread = &threads[0];
+    start_helpers(side);
+
+    // Predict each iteration from the last one and the growth factor
+    // between the last two.
+    long long last_ms = 0;
+    long long previous_ms = 0;
+    for(int depth = 1; depth <= depth_limit; depth++)
     {
-        int total = 0;
-        for(int i = 0; i <= 7; i++)
+        long long growth = previous_ms > 0 ? std::min(std::max(last_ms / previous_ms, 2LL), 8LL) : 4;
+        if(depth > 1 && !time_manager.worth_iterating(last_ms * growth))
+            break;
+
+        long long iter_start_ms = time_manager.elapsed_ms();
+        SearchCounters iter_start_counters = main_thread->counters;
+        Move* iteration_move = nullptr;
+
+        // Aspiration: expect the score to stay near the last iteration's and
+        // search a window around it, widening whichever side it falls out of.
+        // Once deep enough, most iterations finish in the first window. A
+        // fail low proves the root moves worse than the window, but not
+        // which is best, so its move is not used if the clock stops the
+        // search that follows.
+        int delta = aspiration_window;
+        int a = -SCORE_INFINITY, b = SCORE_INFINITY;
+        if(depth >= aspiration_depth && result.best_move >= 0
+            && std::abs(result.score) < SCORE_INFINITY / 4)
         {
-            for(int j = 0; j <= 7; j++)
+            a = result.score - delta;
+            b = result.score + delta;
+        }
+        bool failed_low = false;
+        int score;
+        while(true)
+        {
+            score = negamax_root(main_thread, depth, side, a, b, &iteration_move);
+            if(stop_search || (score > a && score < b))
+                break;
+            main_thread->counters.researches++;
+            delta *= 2;
+            if(score <= a)
             {
-                if(board->get(move_side, i, j))
-                    total += get_weight(board, move_side, i, j);
-                else if(board->get(other_side, i, j))
-                    total -= get_weight(board, other_side, i, j);
+                failed_low = true;
+                a = delta > SCORE_INFINITY / 4 ? -SCORE_INFINITY : std::max(score - delta, -SCORE_INFINITY);
             }
+            else
+            {
+                failed_low = false;
+                b = delta > SCORE_INFINITY / 4 ? SCORE_INFINITY : std::min(score + delta, SCORE_INFINITY);
+            }
+            delete iteration_move;
+            iteration_move = nullptr;
+        }
+        if(stop_search && failed_low)
+        {
+            delete iteration_move;
+            iteration_move = nullptr;
         }
-        return total;
+
+        IterationStats iteration;
+        iteration.depth = depth;
+        iteration.complete = !stop_search;
+        iteration.score = score;
+        iteration.ms = time_manager.elapsed_ms() - iter_start_ms;
+        iteration.counters = main_thread->counters - iter_start_counters;
+        result.stats.iterations.push_back(iteration);
+
+        if(iteration_move)
+        {
+            result.best_move = SQUARE(iteration_move->x, iteration_move->y);
+            result.score = score;
+            main_thread->move_orderer.pv_move = result.best_move;
+            delete iteration_move;
+        }
+        if(stop_search)
+            break;
+        result.depth = depth;
+        previous_ms = last_ms;
+        last_ms = std::max(time_manager.elapsed_ms() - iter_start_ms, 1LL);
     }
+    stop_helpers();
+
+    // Out of time before even one move was searched: any legal move beats
+    // forfeiting by passing.
+    uint64_t moves = position->getMoves(side);
+    if(result.best_move < 0 && moves)
+        result.best_move = pop_square(moves);
+
+    for(size_t i = 0; i < threads.size(); i++)
+        result.stats.totals += threads[i].counters;
+    result.nodes = result.stats.totals.nodes;
+    result.ms = time_manager.elapsed_ms();
+    return result;
 }
 
-int Player::get_weight(Board* board, char othelloside, int i, int j)
+/*
+ * Solves position exactly for side with the endgame solver, giving up at the
+ * time manager's hard deadline. ms_left is as for search(). The solver runs
+ * on this thread alone; the helpers only take part in search().
+ */
+SearchResult Player::solve(Board* position, char side, int ms_left)
 {
-    return weights[i][j];
+    SearchResult result = { -1, 0, 0, false, 0, 0 };
+    begin_search(position, ms_left);
+    EndgameSolver solver(&transpositions, &time_manager);
+    result.score = solver.solve_root(position, side, &result.best_move);
+    result.solved = !solver.aborted;
+    result.depth = result.solved ? popcount(position->empties()) : 0;
+    result.stats.totals = solver.counters;
+    result.nodes = solver.counters.nodes;
+    result.ms = time_manager.elapsed_ms();
+    return result;
+}
+
+/*
+ * Searches position for side by Monte Carlo tree search until the time
+ * manager's soft deadline, or for the node limit in playouts, or for
+ * default_playouts if there is neither. ms_left is as for search().
+ */
+SearchResult Player::search_mcts(Board* position, char side, int ms_left)
+{
+    SearchResult result = { -1, 0, 0, false, 0, 0 };
+    begin_search(position, ms_left);
+    uint64_t playout_limit = node_limit;
+    if(!playout_limit && time_manager.soft_ms() < 0)
+        playout_limit = default_playouts;
+    MctsResult mcts_result = mcts->search(position->pieces(side),
+        position->pieces(OTHER_SIDE(side)), &time_manager, playout_limit, threads.size());
+    result.best_move = mcts_result.best_move;
+    result.score = (int) (mcts_result.expected * 100 + 0.5f);
+    result.depth = mcts_result.depth;
+    result.playouts = mcts_result.playouts;
+
+    // No root move was played out, as when the clock stops the search at
+    // once: any legal move beats passing.
+    uint64_t moves = position->getMoves(side);
+    if(result.best_move < 0 && moves)
+        result.best_move = pop_square(moves);
+
+    result.ms = time_manager.elapsed_ms();
+    return result;
+}
+
+/*
+ * Forgets everything learned in earlier searches, and starts counting moves
+ * again.
+ */
+void Player::new_game()
+{
+    stop_ponder();
+    moves_played = 0;
+    transpositions.clear();
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].move_orderer.clear();
+    if(mcts)
+        mcts->clear();
+}
+
+/*
+ * Picks the position to search while the opponent thinks and starts the
+ * ponder thread on it: the position after the reply the table has as best,
+ * or after the forced pass, or failing those the opponent's own position.
+ * Positions in the book are not worth it.
+ */
+void Player::start_ponder(int msLeft)
+{
+    char other_side = OTHER_SIDE(player_side);
+    uint64_t replies = board->getMoves(other_side);
+    OthelloNode node;
+    ponder_board = *board;
+    ponder_depth = msLeft == -1 ? fixed_depth : max_depth;
+
+    if(!replies)
+    {
+        if(!board->hasMoves(player_side))
+            return;
+        ponder_move = -1;
+        ponder_side = player_side;
+    }
+    else if(transpositions.probe(board->hash(other_side), &node)
+        && node.best_move_exists() && (replies >> node.best_move & 1))
+    {
+        UndoRecord undo;
+        ponder_board.makeMove(node.best_move, other_side, &undo);
+        if(!ponder_board.hasMoves(player_side))
+            return;
+        ponder_move = node.best_move;
+        ponder_side = player_side;
+    }
+    else
+    {
+        ponder_move = -2;
+        ponder_side = other_side;
+    }
+
+    BookEntry entry;
+    if(ponder_side == player_side && book.probe(ponder_board.pieces(player_side),
+            ponder_board.pieces(other_side), &entry))
+        return;
+
+    clock_started = false;
+    ponder_thread = std::thread(&Player::ponder, this);
+}
+
+/*
+ * Body of the ponder thread: an unlimited search or solve of ponder_board,
+ * ended by stop_ponder() or given a budget by doMove() on a hit.
+ */
+void Player::ponder()
+{
+    if(popcount(ponder_board.empties()) <= endgame_empties)
+    {
+        ponder_source = "ponder_solve";
+        ponder_result = solve(&ponder_board, ponder_side, -1);
+    }
+    else
+    {
+        ponder_source = "ponder_search";
+        ponder_result = search(&ponder_board, ponder_side, ponder_depth, -1);
+    }
+}
+
+/*
+ * Ends the ponder search, if one is running, and waits for its thread. The
+ * clock must have started first, or starting it would clear the stop.
+ */
+void Player::stop_ponder()
+{
+    if(!ponder_thread.joinable())
+        return;
+    while(!clock_started)
+        std::this_thread::yield();
+    time_manager.stop();
+    ponder_thread.join();
+}
+
+/**
+ * @brief Returns a weighted sum of all heuristics. The search does not call
+ * this; it evaluates through the policy it was compiled for.
+ */
+int Player::heuristic(Board* board, char move_side)
+{
+    uint64_t self = board->pieces(move_side);
+    uint64_t other = board->pieces(OTHER_SIDE(move_side));
+    if(testingMinimax)
+        return popcount(self) - popcount(other);
+    if(evaluation == EVAL_PATTERNS)
+        return patterns.evaluate(self, other);
+    if(evaluation == EVAL_FEATURES)
+        return feature_evaluation(self, other);
+    return weighted_square_sum(self, other);
+}
+
+/*
+ * Writes one JSON line describing how the move in result was chosen. source
+ * is "book", "search", "mcts" or "solve", or "ponder_search" or
+ * "ponder_solve" for a ponder search that hit. The line starts with the
+ * game id, if there is one.
+ */
+void Player::report_move(const char* source, SearchResult* result, int msLeft)
+{
+    std::ostringstream out;
+    out << "{";
+    if(!game_id.empty())
+    {
+        out << "\"game\": \"";
+        for(size_t i = 0; i < game_id.size(); i++)
+            out << (game_id[i] == '"' || game_id[i] == '\\' ? "\\" : "") << game_id[i];
+        out << "\", ";
+    }
+    out << "\"move_number\": " << ++moves_played
+        << ", \"side\": \"" << player_side << "\""
+        << ", \"source\": \"" << source << "\""
+        << ", \"empties\": " << popcount(board->empties())
+        << ", \"ms_left\": " << msLeft
+        << ", \"move\": \"" << (result->best_move < 0 ? -1 : result->best_move % 8)
+        << "," << (result->best_move < 0 ? -1 : result->best_move / 8) << "\""
+        << ", \"score\": " << result->score
+        << ", \"depth\": " << result->depth
+        << ", \"solved\": " << (result->solved ? "true" : "false")
+        << ", \"ms\": " << result->ms
+        << ", \"threads\": " << threads.size()
+        << ", \"nps\": " << (uint64_t) (result->nodes * 1000.0 / std::max(result->ms, 1LL))
+        << ", ";
+    if(result->playouts)
+        out << "\"playouts\": " << result->playouts
+            << ", \"playouts_per_second\": "
+            << (uint64_t) (result->playouts * 1000.0 / std::max(result->ms, 1LL)) << ", ";
+    result->stats.write_json(out);
+    out << "}\n";
+
+    // Players searching on other threads may share the stream, so each
+    // line goes out whole.
+    static std::mutex stats_lock;
+    std::lock_guard<std::mutex> guard(stats_lock);
+    *stats_out << out.str() << std::flush;
 }
 
 /*
@@ -203,82 +874,85 @@ int Player::get_weight(Board* board, char othelloside, int i, int j)
  */
 Move *Player::doMove(Move *opponentsMove, int msLeft)
 {
-    clock_t begin_time = clock();
     board->doMove(opponentsMove, OTHER_SIDE(player_side));
     Move* best_move = nullptr;
     bool found_opening_book_move = false;
 
-    //print_board(board->data, std::cerr);
+    // If the opponent played the reply we pondered, that search carries on
+    // with this move's budget; otherwise it stops, leaving the table warm.
+    bool ponder_hit = false;
+    if(ponder_thread.joinable())
+    {
+        int reply = opponentsMove ? SQUARE(opponentsMove->x, opponentsMove->y) : -1;
+        if(reply == ponder_move && (msLeft >= 0 || ponder_depth == fixed_depth))
+        {
+            while(!clock_started)
+                std::this_thread::yield();
+            time_manager.set_budget(msLeft, popcount(board->empties()), endgame_empties);
+            ponder_thread.join();
+            ponder_hit = true;
+        }
+        else
+        {
+            stop_ponder();
+        }
+    }
 
     if(testingMinimax)
-        negamax(board, 2, player_side, -INFINITY, INFINITY, &best_move);
+    {
+        SearchResult result = search(board, player_side, 2, -1);
+        if(result.best_move >= 0)
+            best_move = new Move(result.best_move % 8, result.best_move / 8);
+    }
     else 
     {
-        char rotated[65];
-        char temp[65];
-
-        rotated[64] = '\0';
-        temp[64] = '\0';
-        memcpy(rotated, board->data, 64);
-        for(int i = 0; i < 4; i++)
+        BookEntry entry;
+        if(book.probe(board->pieces(player_side),
+                board->pieces(OTHER_SIDE(player_side)), &entry)
+            && (board->getMoves(player_side) >> entry.move & 1))
         {
-            //std::cerr << "Lookup str: " << rotated << std::endl;
-            /*for(auto it = opening_book.begin(); it != opening_book.end(); ++it)
-                std::cerr << "Comparison str: " << it->first << std::endl;*/
-            if(opening_book.count(rotated))
-            {
-                //std::cerr << "Located opening book move" << std::endl;
-                Move rotated_move = rotate_move(opening_book[rotated], i);
-                if(board->checkMove(&rotated_move, player_side))
-                {
-                    best_move = new Move(rotated_move);
-                    found_opening_book_move = true;
-                    break;
-                }
-            }
-            rotate_data(rotated, temp);
-            strcpy(rotated, temp);
+            best_move = new Move(entry.move % 8, entry.move / 8);
+            found_opening_book_move = true;
         }
 
         if(found_opening_book_move)
-            std::cerr << "Used opening book to get move: " << best_move->x << ", " << best_move->y << std::endl;
+        {
+            SearchResult result = { entry.move, entry.score, entry.depth, false, 0, 0 };
+            report_move("book", &result, msLeft);
+        }
         else
         {
-            clock_t next_expected_ms = 0;
-            int depth = 1;
-            if(msLeft == -1)
+            SearchResult result;
+            if(ponder_hit && ponder_result.best_move >= 0)
             {
-                depth = default_depth;
-                negamax(board, depth, player_side, -INFINITY, INFINITY, &best_move);
+                result = ponder_result;
+                report_move(ponder_source, &result, msLeft);
+            }
+            else if(popcount(board->empties()) <= endgame_empties)
+            {
+                result = solve(board, player_side, msLeft);
+                report_move("solve", &result, msLeft);
+            }
+            else if(mcts)
+            {
+                result = search_mcts(board, player_side, msLeft);
+                report_move("mcts", &result, msLeft);
             }
             else
             {
-                for(depth = 1; depth <= max_depth && ((clock() - begin_time + next_expected_ms) * 1000) / CLOCKS_PER_SEC < msLeft / erm; depth++)
-                {
-                    clock_t iter_start_time = clock();
-                    negamax(board, depth, player_side, -INFINITY, INFINITY, &best_move);
-                    clock_t last_ms = clock() - iter_start_time;
-                    next_expected_ms = 4 * last_ms;
-                }
+                result = search(board, player_side, msLeft == -1 ? fixed_depth : max_depth, msLeft);
+                report_move("search", &result, msLeft);
             }
-            std::cerr << "Ran to depth " << (depth - 1) << " in " << (((clock() - begin_time) * 1000) / CLOCKS_PER_SEC) << " ms\n";
+            if(result.best_move >= 0)
+                best_move = new Move(result.best_move % 8, result.best_move / 8);
         }
     }
 
-                
     if(best_move)
         board->doMove(best_move, player_side);
-    if(erm > 1)
-        erm--;
 
-    /*if(best_move && !found_opening_book_move)
-    {
-        std::cerr << "Adding move:\n";
-        print_board(board->data, std::cerr);
-        std::cerr << "\nMove:" << best_move->x << ", " << best_move->y << std::endl;
-        opening_book[board->data] = *best_move;
-    }*/
-    /*if(board->isDone())
-        write_book("presbyterian_ghostbusters_moves");*/
+    if(ponder_enabled && !testingMinimax && !mcts)
+        start_ponder(msLeft);
+
     return best_move;
 }
@@ -2,30 +2,173 @@
 
 #include "board.hpp"
 #include "othello_node.hpp"
+#include "transposition_table.hpp"
+#include "move_ordering.hpp"
+#include "endgame.hpp"
+#include "time_manager.hpp"
+#include "search_stats.hpp"
+#include "pattern_eval.hpp"
+#include "opening_book.hpp"
+#include "probcut.hpp"
+#include "mcts.hpp"
 #include "common.hpp"
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <thread>
 #include <vector>
 
+/*
+ * State private to one search thread. Thread 0 runs on the caller of
+ * doMove(); the others are Lazy SMP helpers that share only the
+ * transposition table with it.
+ */
+struct SearchThread
+{
+    int id;
+    Board board;
+    MoveOrderer move_orderer;
+    SearchCounters counters;
+};
+
+/*
+ * Kinds of node negamax is compiled for. The root must produce a move; a PV
+ * node has an open window, and a scout node a null one that only asks
+ * whether the score beats it, so it never searches a child twice.
+ */
+enum NodeType
+{
+    NODE_ROOT,
+    NODE_PV,
+    NODE_SCOUT
+};
+
+/*
+ * Outcome of Player::search() or Player::solve() on one position.
+ */
+struct SearchResult
+{
+    int best_move;      // Square, or -1 to pass
+    int score;          // For MCTS, the expected share of the points in percent
+    int depth;          // Last completed depth, or the empties if solved
+    bool solved;        // score is the exact final disc difference
+    uint64_t nodes;
+    long long ms;
+    SearchStats stats;
+    uint64_t playouts;  // MCTS only
+};
+
+/*
+ * Static evaluations the search can use at its leaves.
+ */
+enum Evaluation
+{
+    EVAL_SQUARES,   // Fixed weight per occupied square
+    EVAL_PATTERNS,  // Trained pattern tables, when a weight file is loaded
+    EVAL_FEATURES   // Mobility, frontier, stability and parity, tapered by phase
+};
+
+const char* evaluation_name(Evaluation evaluation);
+bool parse_evaluation(const char* name, Evaluation* evaluation);
+
+/*
+ * How the player chooses moves out of the book and before the endgame
+ * solver takes over.
+ */
+enum SearchEngine
+{
+    ENGINE_ALPHA_BETA,  // Iterative deepening negamax on the evaluation
+    ENGINE_MCTS         // Monte Carlo tree search with random playouts
+};
+
 class Player {
 private:
     Board* board;
-    //std::map<Board, OthelloNode, BoardCmp> transpositions;
-    int erm;            // Estimated remaining moves (for use in timing)
+    TranspositionTable transpositions;
+    OpeningBook& book;         // Shared by every Player in the process
+    std::vector<SearchThread> threads;
+    std::vector<std::thread> helpers;
+    std::atomic<bool> stop_search;
+    std::atomic<bool> clock_started;    // begin_search() has started time_manager
+    TimeManager time_manager;
+    int endgame_empties;    // Solve exactly at or below this many empties
+    int fixed_depth;        // Search depth when there is no time limit
+    uint64_t node_limit;    // Main thread nodes per search, 0 for no limit
+    int moves_played;
+    std::ofstream stats_file;
+    std::ostream* stats_out;    // Where the per-move statistics go
+    std::string game_id;        // Names the game in them, if not empty
+    const PatternEvaluator& patterns;     // Shared, as is probcut
+    Evaluation evaluation;
+    const ProbCut& probcut;
+    float probcut_confidence;   // Cut at this many sigmas, 0 for never
+    bool use_probcut;           // Set for each search by begin_search()
     char player_side;
-    static const int weights[8][8];
+    SearchEngine engine;
+    MonteCarloSearch* mcts;     // Only for ENGINE_MCTS
+
+    // Search on the opponent's time. After each move the position after the
+    // reply the table expects is searched in the background; ponder_move is
+    // that reply, -1 for a pass, or -2 if the position searched is the one
+    // before the reply, to fill the table for all of them.
+    bool ponder_enabled;
+    std::thread ponder_thread;
+    Board ponder_board;
+    char ponder_side;
+    int ponder_move;
+    int ponder_depth;
+    const char* ponder_source;
+    SearchResult ponder_result;
+
+    void ponder();
+    void start_ponder(int msLeft);
+    void stop_ponder();
 
 public:
     static const int default_depth;
     static const int max_depth;
+    static const int tt_log2_entries;
+    static const int default_endgame_empties;
+    static const int aspiration_depth;      // First depth with a narrow root window
+    static const int aspiration_window;     // Half its width
+    static const char* const pattern_file;
+    static const char* const book_file;
+    static const char* const probcut_file;
+    static const float default_probcut_confidence;
+    static const int mcts_log2_nodes;
+    static const uint64_t default_playouts;  // Per move with no time limit
 
-    Player(char side_in);
+    Player(char side_in, int num_threads = 0, SearchEngine engine_in = ENGINE_ALPHA_BETA,
+        int tt_log2 = tt_log2_entries);
     ~Player();
 
     void set_board(Board* board);
-    int get_weight(Board* board, char move_side, int i, int j);
+    void set_threads(int num_threads);
+    void set_endgame_empties(int empties);
+    void set_depth(int depth);
+    void set_node_limit(uint64_t nodes);
+    void set_move_time(int ms);
+    void set_probcut_confidence(float confidence);
+    void set_stats_file(const char* filename);
+    void set_game_id(const std::string& id);
+    void set_ponder(bool enabled);
+    bool set_evaluation(Evaluation evaluation_in);
+    void report_move(const char* source, SearchResult* result, int msLeft);
     int heuristic(Board* board, char move_side);
-    void get_possible_moves(Board* board, char side, std::vector<Move>* moves);
-    int negamax(Board* board, int depth, char move_side, int a, int b, Move** m=nullptr);
+    int negamax_root(SearchThread* thread, int depth, char side, int a, int b, Move** m=nullptr);
+    template<class Eval>
+    int negamax_root(SearchThread* thread, int depth, char side, int a, int b, Move** m);
+    template<class Eval, NodeType type, char side>
+    int negamax(SearchThread* thread, int depth, int ply, int a, int b, Move** m=nullptr);
+    void begin_search(Board* position, int ms_left);
+    void start_helpers(char side);
+    void stop_helpers();
+    void helper_search(SearchThread* thread, char side);
+    SearchResult search(Board* position, char side, int depth_limit, int ms_left);
+    SearchResult solve(Board* position, char side, int ms_left);
+    SearchResult search_mcts(Board* position, char side, int ms_left);
+    void new_game();
     Move *doMove(Move *opponentsMove, int msLeft);
 
     // Flag to tell if the player is running within the test_minimax context
@@ -0,0 +1,99 @@
+#include "probcut.hpp"
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+ProbCut::ProbCut()
+{
+    memset(params, 0, sizeof(params));
+}
+
+/*
+ * Reads a parameter file. Returns false, leaving nothing loaded, if the file
+ * is missing or malformed.
+ */
+bool ProbCut::load(const char* filename)
+{
+    evaluation_name.clear();
+    memset(params, 0, sizeof(params));
+
+    std::ifstream input(filename);
+    std::string magic, name;
+    int version;
+    if(!(input >> magic >> version >> name) || magic != "probcut"
+        || version != file_version)
+        return false;
+
+    std::string line;
+    while(std::getline(input, line))
+    {
+        if(line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        int depth, shallow, phase_index;
+        float slope, intercept, sigma;
+        if(!(fields >> depth >> shallow >> phase_index >> slope >> intercept >> sigma))
+        {
+            if(line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            memset(params, 0, sizeof(params));
+            return false;
+        }
+        if(depth < min_depth || depth > max_depth || shallow < 1 || shallow >= depth
+            || phase_index < 0 || phase_index >= num_phases || slope <= 0 || sigma < 0)
+            continue;
+        ProbCutParams& p = params[depth - min_depth][phase_index];
+        p.shallow_depth = shallow;
+        p.slope = slope;
+        p.intercept = intercept;
+        p.sigma = sigma;
+    }
+
+    // Calibrating deep searches is slow, so the file may stop short of the
+    // depths the search reaches. Above the deepest calibrated depth of each
+    // phase, reuse its fit with the shallow search the same distance behind.
+    for(int p = 0; p < num_phases; p++)
+    {
+        const ProbCutParams* deepest = nullptr;
+        int deepest_depth = 0;
+        for(int depth = min_depth; depth <= max_depth; depth++)
+        {
+            ProbCutParams& params_here = params[depth - min_depth][p];
+            if(params_here.shallow_depth)
+            {
+                deepest = &params_here;
+                deepest_depth = depth;
+            }
+            else if(deepest)
+            {
+                params_here = *deepest;
+                params_here.shallow_depth = depth - (deepest_depth - deepest->shallow_depth);
+            }
+        }
+    }
+
+    evaluation_name = name;
+    return true;
+}
+
+/*
+ * Depth of the shallow search that predicts a search of depth: about half
+ * as deep, with the same parity, since Othello scores swing with whose move
+ * the leaves fall on.
+ */
+int ProbCut::shallow_depth(int depth)
+{
+    int shallow = depth / 2;
+    if((depth - shallow) & 1)
+        shallow--;
+    return shallow < 1 ? 1 : shallow;
+}
+
+/*
+ * Game phase for the parameters: one per ten empty squares, as for the
+ * pattern tables.
+ */
+int ProbCut::phase(int empties)
+{
+    return (empties < 59 ? empties : 59) / 10;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+
+/*
+ * Multi-ProbCut: a shallow search predicts the result of a deep one well
+ * enough that, when the prediction lies far outside the window, the deep
+ * search can be skipped. For each deep depth and game phase, calibration
+ * fits
+ *
+ *     deep score = slope * shallow score + intercept, with error sigma,
+ *
+ * and a node is cut when the shallow score shows the deep one is beyond the
+ * window by at least confidence * sigma.
+ *
+ * The parameters are fitted by probcut_calibrate for one evaluation and
+ * read from a text file: a line "probcut 1 <evaluation>", then one line per
+ * depth and phase of
+ *
+ *     depth shallow_depth phase slope intercept sigma samples
+ *
+ * Depths above the deepest one calibrated for a phase reuse its fit; other
+ * depths and phases missing from the file are never cut.
+ */
+struct ProbCutParams
+{
+    int shallow_depth;      // 0 if this depth and phase are not calibrated
+    float slope;
+    float intercept;
+    float sigma;
+};
+
+class ProbCut {
+public:
+    static const int min_depth = 3;
+    static const int max_depth = 16;
+    static const int num_phases = 6;
+    static const int file_version = 1;
+
+    ProbCut();
+
+    bool load(const char* filename);
+    bool loaded() const { return !evaluation_name.empty(); }
+    const std::string& evaluation() const { return evaluation_name; }
+
+    static int shallow_depth(int depth);
+    static int phase(int empties);
+
+    /*
+     * Parameters for a deep search of depth at a position with empties
+     * empty squares, or nullptr if there are none.
+     */
+    const ProbCutParams* find(int depth, int empties) const
+    {
+        if(depth < min_depth || depth > max_depth)
+            return nullptr;
+        const ProbCutParams* p = &params[depth - min_depth][phase(empties)];
+        return p->shallow_depth ? p : nullptr;
+    }
+
+private:
+    std::string evaluation_name;
+    ProbCutParams params[max_depth - min_depth + 1][num_phases];
+};
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "player.hpp"
+#include "probcut.hpp"
+using namespace std;
+
+// Fits the Multi-ProbCut parameters for one evaluation.
+//
+// Every position is searched by iterative deepening to --depth with
+// ProbCut off, which gives its score at each depth in one search. For each
+// depth from ProbCut::min_depth up and each phase, the scores at that depth
+// are regressed on those at its shallow depth, and the fit is written in the
+// format ProbCut::load reads.
+//
+// Positions are read one per line as a 64-character board and the side to
+// move, as analyze and pattern_train write them; with --positions N, N of
+// them are taken evenly spread through the file.
+
+static const int min_samples = 50;     // Fewer leave a depth and phase uncut
+
+// Sums for a least-squares fit of deep scores (y) on shallow ones (x).
+struct Fit {
+    double n, x, y, xx, xy, yy;
+
+    void add(double sx, double sy) {
+        n++;
+        x += sx;
+        y += sy;
+        xx += sx * sx;
+        xy += sx * sy;
+        yy += sy * sy;
+    }
+    void merge(const Fit& other) {
+        n += other.n;
+        x += other.x;
+        y += other.y;
+        xx += other.xx;
+        xy += other.xy;
+        yy += other.yy;
+    }
+};
+
+static const int num_depths = ProbCut::max_depth - ProbCut::min_depth + 1;
+typedef Fit Fits[num_depths][ProbCut::num_phases];
+
+static bool parse_position(const string& line, Board *board, char *side) {
+    if (line.size() < 66) return false;
+    char data[64];
+    for (int i = 0; i < 64; i++) {
+        char c = line[i];
+        if (c == BLACK || c == WHITE) data[i] = c;
+        else if (c == '-' || c == '.' || c == ' ') data[i] = ' ';
+        else return false;
+    }
+    size_t s = line.find_first_not_of(" \t", 64);
+    if (s == string::npos || (line[s] != BLACK && line[s] != WHITE)) return false;
+    board->setBoard(data);
+    *side = line[s];
+    return board->hasMoves(*side);
+}
+
+int main(int argc, char *argv[]) {
+    int max_depth = 10, threads = 0, limit = 0;
+    Evaluation evaluation = EVAL_PATTERNS;
+    vector<const char *> files;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--depth") && i + 1 < argc) max_depth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--positions") && i + 1 < argc) limit = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--eval") && i + 1 < argc
+            && parse_evaluation(argv[i + 1], &evaluation)) i++;
+        else if (argv[i][0] != '-') files.push_back(argv[i]);
+        else files.clear(), i = argc;
+    }
+    if (files.size() != 2 || max_depth < ProbCut::min_depth || max_depth > ProbCut::max_depth) {
+        cerr << "usage: " << argv[0] << " [--depth N] [--positions N] [--threads N]"
+             << " [--eval squares|patterns|features] positions_file out_file" << endl;
+        exit(-1);
+    }
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+
+    ifstream input(files[0]);
+    if (!input) {
+        cerr << "cannot open " << files[0] << endl;
+        exit(-1);
+    }
+    vector<string> lines;
+    string line;
+    while (getline(input, line))
+        if (!line.empty() && line[0] != '#') lines.push_back(line);
+    if (limit > 0 && (size_t) limit < lines.size()) {
+        vector<string> spread;
+        for (int i = 0; i < limit; i++) spread.push_back(lines[i * lines.size() / limit]);
+        lines.swap(spread);
+    }
+
+    Fits fits;
+    memset(fits, 0, sizeof(fits));
+    atomic<size_t> next(0);
+    mutex lock;
+    bool ok = true;
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread([&]() {
+            Player player(BLACK, 1);
+            player.set_probcut_confidence(0);
+            if (!player.set_evaluation(evaluation)) {
+                lock_guard<mutex> guard(lock);
+                ok = false;
+                return;
+            }
+            Fits local;
+            memset(local, 0, sizeof(local));
+            for (size_t i = next++; i < lines.size(); i = next++) {
+                Board board;
+                char side;
+                if (!parse_position(lines[i], &board, &side)) continue;
+                int empties = popcount(board.empties());
+                player.new_game();
+                SearchResult result = player.search(&board, side, max_depth, -1);
+
+                // Scores by depth; searches that reach the end of the game
+                // score wins and losses, which predict nothing.
+                vector<int> scores(max_depth + 1, 0);
+                for (size_t k = 0; k < result.stats.iterations.size(); k++) {
+                    const IterationStats& iteration = result.stats.iterations[k];
+                    if (iteration.complete) scores[iteration.depth] = iteration.score;
+                }
+                int phase = ProbCut::phase(empties);
+                for (int depth = ProbCut::min_depth; depth <= max_depth && depth < empties; depth++) {
+                    int shallow = ProbCut::shallow_depth(depth);
+                    if (abs(scores[depth]) >= SCORE_INFINITY / 4 || abs(scores[shallow]) >= SCORE_INFINITY / 4)
+                        continue;
+                    local[depth - ProbCut::min_depth][phase].add(scores[shallow], scores[depth]);
+                }
+                if ((i + 1) % 100 == 0)
+                    fprintf(stderr, "searched %zu of %zu positions\n", i + 1, lines.size());
+            }
+
+            lock_guard<mutex> guard(lock);
+            for (int d = 0; d < num_depths; d++)
+                for (int p = 0; p < ProbCut::num_phases; p++)
+                    fits[d][p].merge(local[d][p]);
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    if (!ok) {
+        cerr << "cannot load " << Player::pattern_file << endl;
+        exit(-1);
+    }
+
+    FILE *out = fopen(files[1], "w");
+    if (!out) {
+        cerr << "cannot write " << files[1] << endl;
+        exit(-1);
+    }
+    fprintf(out, "probcut %d %s\n", ProbCut::file_version, evaluation_name(evaluation));
+    fprintf(out, "# depth shallow_depth phase slope intercept sigma samples\n");
+    for (int depth = ProbCut::min_depth; depth <= max_depth; depth++) {
+        for (int p = 0; p < ProbCut::num_phases; p++) {
+            const Fit& f = fits[depth - ProbCut::min_depth][p];
+            if (f.n < min_samples) continue;
+            double mx = f.x / f.n, my = f.y / f.n;
+            double var_x = f.xx / f.n - mx * mx;
+            double cov = f.xy / f.n - mx * my;
+            double var_y = f.yy / f.n - my * my;
+            if (var_x <= 0) continue;
+            double slope = cov / var_x;
+            double intercept = my - slope * mx;
+            double sigma = sqrt(max(var_y - slope * cov, 0.0));
+            fprintf(out, "%d %d %d %.4f %.2f %.2f %d\n", depth, ProbCut::shallow_depth(depth),
+                p, slope, intercept, sigma, (int) f.n);
+        }
+    }
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * splitmix64: a small, fast generator for the tools and the Monte Carlo
+ * playouts. The same seed always gives the same stream, so runs can be
+ * repeated.
+ */
+struct Random
+{
+    uint64_t state;
+
+    Random(uint64_t seed) : state(seed) {}
+
+    uint64_t operator()()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+};
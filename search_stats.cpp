@@ -0,0 +1,85 @@
+#include "search_stats.hpp"
+#include <string.h>
+
+void SearchCounters::clear()
+{
+    memset(this, 0, sizeof(*this));
+}
+
+SearchCounters& SearchCounters::operator+=(const SearchCounters& other)
+{
+    nodes += other.nodes;
+    leaves += other.leaves;
+    cutoffs += other.cutoffs;
+    first_move_cutoffs += other.first_move_cutoffs;
+    researches += other.researches;
+    probcuts += other.probcuts;
+    tt_probes += other.tt_probes;
+    tt_hits += other.tt_hits;
+    tt_stores += other.tt_stores;
+    return *this;
+}
+
+SearchCounters SearchCounters::operator-(const SearchCounters& other) const
+{
+    SearchCounters difference = *this;
+    difference.nodes -= other.nodes;
+    difference.leaves -= other.leaves;
+    difference.cutoffs -= other.cutoffs;
+    difference.first_move_cutoffs -= other.first_move_cutoffs;
+    difference.researches -= other.researches;
+    difference.probcuts -= other.probcuts;
+    difference.tt_probes -= other.tt_probes;
+    difference.tt_hits -= other.tt_hits;
+    difference.tt_stores -= other.tt_stores;
+    return difference;
+}
+
+/*
+ * Writes the counters as JSON members, without the enclosing braces, so they
+ * can be embedded in a larger object.
+ */
+void SearchCounters::write_json(std::ostream& out) const
+{
+    out << "\"nodes\": " << nodes
+        << ", \"leaves\": " << leaves
+        << ", \"cutoffs\": " << cutoffs
+        << ", \"first_move_cutoff_rate\": "
+        << (cutoffs ? (double) first_move_cutoffs / cutoffs : 0.0)
+        << ", \"researches\": " << researches
+        << ", \"probcuts\": " << probcuts
+        << ", \"tt_probes\": " << tt_probes
+        << ", \"tt_hits\": " << tt_hits
+        << ", \"tt_stores\": " << tt_stores;
+}
+
+void SearchStats::clear()
+{
+    totals.clear();
+    iterations.clear();
+}
+
+/*
+ * Writes the totals and an "iterations" array as JSON members, without the
+ * enclosing braces. Each iteration's effective branching factor is its node
+ * count over the previous iteration's.
+ */
+void SearchStats::write_json(std::ostream& out) const
+{
+    totals.write_json(out);
+    out << ", \"iterations\": [";
+    for(size_t i = 0; i < iterations.size(); i++)
+    {
+        const IterationStats& iteration = iterations[i];
+        out << (i ? ", " : "") << "{\"depth\": " << iteration.depth
+            << ", \"complete\": " << (iteration.complete ? "true" : "false")
+            << ", \"score\": " << iteration.score
+            << ", \"ms\": " << iteration.ms << ", ";
+        iteration.counters.write_json(out);
+        if(i > 0 && iterations[i - 1].counters.nodes)
+            out << ", \"ebf\": " << (double) iteration.counters.nodes
+                                    / iterations[i - 1].counters.nodes;
+        out << "}";
+    }
+    out << "]";
+}
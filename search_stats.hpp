@@ -0,0 +1,52 @@
+#pragma once
+
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Event counts gathered during a search. Each search thread keeps its own
+ * set, so counting costs a plain increment; they are summed when the search
+ * is over.
+ */
+struct SearchCounters
+{
+    uint64_t nodes;
+    uint64_t leaves;                // Heuristic evaluations or final scores
+    uint64_t cutoffs;               // Beta cutoffs
+    uint64_t first_move_cutoffs;    // Beta cutoffs by the first move tried
+    uint64_t researches;            // Null-window scouts that failed high,
+                                    // and root windows that failed
+    uint64_t probcuts;              // Nodes cut by Multi-ProbCut
+    uint64_t tt_probes;
+    uint64_t tt_hits;
+    uint64_t tt_stores;
+
+    void clear();
+    SearchCounters& operator+=(const SearchCounters& other);
+    SearchCounters operator-(const SearchCounters& other) const;
+    void write_json(std::ostream& out) const;
+};
+
+// Counters and time of one iterative-deepening iteration of the main thread.
+struct IterationStats
+{
+    int depth;
+    bool complete;      // False if the clock stopped it part way
+    int score;          // Of the best move, if complete
+    long long ms;
+    SearchCounters counters;
+};
+
+/*
+ * Statistics of one search: totals over all threads, plus a breakdown by
+ * iteration for the main thread.
+ */
+struct SearchStats
+{
+    SearchCounters totals;
+    std::vector<IterationStats> iterations;
+
+    void clear();
+    void write_json(std::ostream& out) const;
+};
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Feeds the server malformed lines and checks that each one is answered with
+# an error and not played, and that a good move after them still is.
+
+player=./presbyterian_ghostbusters
+output=$(printf '%s\n' \
+    'g start Black' \
+    'g strat 3 4' \
+    'g 9 3 1000' \
+    'g 3 9 1000' \
+    'g -1 3 1000' \
+    'g 3x 3 1000' \
+    'g 3 3' \
+    'g 3 3 1000 4' \
+    'g 2 3 soon' \
+    'g 99999999999 3 1000' \
+    'h 3 3 1000' \
+    'g -1 -1 5000' \
+    'g end' \
+    | $player 1 /dev/null --server --hash=1)
+
+status=0
+expect() {
+    count=$(printf '%s\n' "$output" | grep -c -x -e "$1")
+    if [ "$count" != "$2" ]; then
+        echo "expected $2 lines matching '$1', got $count"
+        status=1
+    fi
+}
+
+expect 'Init done' 1
+expect 'g error expected X Y MS' 9
+expect 'h error no such game' 1
+expect 'g [0-7] [0-7]' 1
+expect '.*' 12
+
+if [ $status = 0 ]; then
+    echo "Server tests passed"
+else
+    printf '%s\n' "$output"
+fi
+exit $status
@@ -0,0 +1,127 @@
+#include "time_manager.hpp"
+#include <algorithm>
+
+// Held back from every budget for process and pipe overhead.
+const int TimeManager::safety_ms = 50;
+
+// Share of the game's time the endgame solve gets, counted in moves.
+static const int SOLVE_SHARE = 3;
+
+TimeManager::TimeManager()
+    : soft_deadline_ms(-1),
+      hard_deadline_ms(-1),
+      stopped(false),
+      move_ms(0)
+{
+}
+
+/*
+ * Starts the clock for a move with ms_left milliseconds left for the game
+ * (-1 for no limit) and the given number of empty squares.
+ *
+ * Each side plays about half the remaining empties. Midgame moves up to the
+ * solver's threshold share the time equally with a few moves' worth set
+ * aside for the solve; once solving, the remaining moves share what is left
+ * (though a successful solve makes them all instant). The hard deadline
+ * allows an iteration to run to four times the even share, but never more
+ * than a third of the time left.
+ */
+void TimeManager::start(int ms_left, int empties, int endgame_empties)
+{
+    start_time = Clock::now();
+    stopped = false;
+    set_budget(ms_left, empties, endgame_empties);
+}
+
+/*
+ * Replaces the deadlines of the running search with those start() would
+ * give it, counted from now rather than from when the search began.
+ */
+void TimeManager::set_budget(int ms_left, int empties, int endgame_empties)
+{
+    if(move_ms > 0)
+    {
+        long long now = elapsed_ms();
+        hard_deadline_ms = now + move_ms;
+        soft_deadline_ms = now + move_ms;
+        return;
+    }
+    if(ms_left < 0)
+    {
+        soft_deadline_ms = -1;
+        hard_deadline_ms = -1;
+        return;
+    }
+
+    int moves_left;
+    if(empties > endgame_empties)
+        moves_left = (empties - endgame_empties + 1) / 2 + SOLVE_SHARE;
+    else
+        moves_left = (empties + 1) / 2;
+    moves_left = std::max(moves_left, 1);
+
+    long long usable = std::max(ms_left - safety_ms, 0);
+    long long soft = usable / moves_left;
+    long long hard = std::min(4 * soft, usable / 3);
+    long long now = elapsed_ms();
+    hard_deadline_ms = now + std::max(hard, soft);
+    soft_deadline_ms = now + soft;
+}
+
+/*
+ * Gives every move ms milliseconds, both soft and hard, whatever the time
+ * left for the game. 0 goes back to budgeting from the clock.
+ */
+void TimeManager::set_move_time(int ms)
+{
+    move_ms = ms;
+}
+
+/*
+ * Ends the running search: both deadlines count as passed until the next
+ * start().
+ */
+void TimeManager::stop()
+{
+    stopped = true;
+}
+
+long long TimeManager::elapsed_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        Clock::now() - start_time).count();
+}
+
+/*
+ * Time from start() to the soft deadline in milliseconds, or -1 if there is
+ * no limit.
+ */
+long long TimeManager::soft_ms()
+{
+    return soft_deadline_ms;
+}
+
+bool TimeManager::soft_expired()
+{
+    long long deadline = soft_deadline_ms;
+    return stopped || (deadline >= 0 && elapsed_ms() >= deadline);
+}
+
+bool TimeManager::hard_expired()
+{
+    long long deadline = hard_deadline_ms;
+    return stopped || (deadline >= 0 && elapsed_ms() >= deadline);
+}
+
+/*
+ * Whether another iteration expected to take predicted_ms should start. It
+ * should be expected to end near the soft deadline, so that moves average
+ * out to their share; the hard deadline catches the ones that run long.
+ */
+bool TimeManager::worth_iterating(long long predicted_ms)
+{
+    long long deadline = soft_deadline_ms;
+    if(stopped)
+        return false;
+    return deadline < 0 || elapsed_ms() + predicted_ms / 2 < deadline;
+}
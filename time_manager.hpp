@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+/*
+ * Wall-clock time budget for one move. The soft deadline is when iterative
+ * deepening stops starting new iterations; the hard deadline is when a
+ * running search is abandoned. Both are set by start() from the time left
+ * for the game and the number of our moves still to come.
+ *
+ * A search started without a limit, such as a ponder search, can be given
+ * one while it runs with set_budget(), or ended at once with stop(); the
+ * deadlines are atomic so the searching threads see the change.
+ *
+ * With set_move_time(), every move gets the same fixed time instead, and the
+ * game clock is ignored.
+ */
+class TimeManager {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point start_time;
+    std::atomic<long long> soft_deadline_ms;    // After start_time, -1 if none
+    std::atomic<long long> hard_deadline_ms;
+    std::atomic<bool> stopped;
+    int move_ms;        // Fixed time per move, 0 to budget from the clock
+
+public:
+    static const int safety_ms;
+
+    TimeManager();
+
+    void start(int ms_left, int empties, int endgame_empties);
+    void set_budget(int ms_left, int empties, int endgame_empties);
+    void set_move_time(int ms);
+    void stop();
+    long long elapsed_ms();
+    long long soft_ms();
+    bool soft_expired();
+    bool hard_expired();
+    bool worth_iterating(long long predicted_ms);
+};
@@ -0,0 +1,124 @@
+#include "transposition_table.hpp"
+#include <limits>
+
+const int TranspositionTable::bucket_size = 4;
+
+/*
+ * Returns the log2_entries of the largest table that fits in megabytes, or
+ * of the smallest table if none does.
+ */
+int TranspositionTable::log2_entries(int megabytes)
+{
+    int log2 = 2;
+    while(log2 < 40 && (sizeof(Slot) << (log2 + 1)) <= ((uint64_t) megabytes << 20))
+        log2++;
+    return log2;
+}
+
+/*
+ * Allocates a table of 2^log2_entries entries.
+ */
+TranspositionTable::TranspositionTable(int log2_entries)
+    : slots(new Slot[1ULL << log2_entries]),
+      bucket_mask((1ULL << log2_entries) / bucket_size - 1),
+      age(0)
+{
+    clear();
+}
+
+TranspositionTable::~TranspositionTable()
+{
+    delete[] slots;
+}
+
+void TranspositionTable::clear()
+{
+    for(uint64_t i = 0; i < (bucket_mask + 1) * bucket_size; i++)
+    {
+        slots[i].check.store(0, std::memory_order_relaxed);
+        slots[i].data.store(0, std::memory_order_relaxed);
+    }
+    age = 0;
+}
+
+/*
+ * Marks the start of a new search. Entries written by earlier searches are
+ * kept for their moves and bounds but become the first to be replaced. Must
+ * not be called while a search is running.
+ */
+void TranspositionTable::new_search()
+{
+    age++;
+}
+
+/*
+ * Looks up key and copies its entry into node. Returns false if the position
+ * is not in the table.
+ */
+bool TranspositionTable::probe(uint64_t key, OthelloNode* node)
+{
+    Slot* bucket = slots + (key & bucket_mask) * bucket_size;
+    for(int i = 0; i < bucket_size; i++)
+    {
+        uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+        uint64_t check = bucket[i].check.load(std::memory_order_relaxed);
+        if((check ^ data) == key && data != 0)
+        {
+            node->key = key;
+            node->unpack(data);
+            return node->bound != BOUND_NONE;
+        }
+    }
+    return false;
+}
+
+/*
+ * Records the result of a search of the given depth. An existing entry for
+ * the same position is overwritten unless it holds a deeper result from this
+ * search. Otherwise the entry replaced is the one whose depth, less a penalty
+ * for each search since it was written, is smallest.
+ */
+void TranspositionTable::store(uint64_t key, int depth, int score, int bound,
+    int best_move)
+{
+    Slot* bucket = slots + (key & bucket_mask) * bucket_size;
+    Slot* replace = bucket;
+    int replace_worth = SCORE_INFINITY;
+    for(int i = 0; i < bucket_size; i++)
+    {
+        OthelloNode entry;
+        uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+        uint64_t check = bucket[i].check.load(std::memory_order_relaxed);
+        entry.unpack(data);
+        if((check ^ data) == key)
+        {
+            if(entry.age == age && entry.depth_checked > depth
+                && bound != BOUND_EXACT)
+                return;
+            if(best_move < 0)
+                best_move = entry.best_move;
+            replace = bucket + i;
+            break;
+        }
+
+        int stale = (uint8_t)(age - entry.age);
+        int worth = entry.bound == BOUND_NONE ? -SCORE_INFINITY / 2
+                                              : entry.depth_checked - 4 * stale;
+        if(worth < replace_worth)
+        {
+            replace = bucket + i;
+            replace_worth = worth;
+        }
+    }
+
+    OthelloNode node;
+    node.key = key;
+    node.score = score;
+    node.depth_checked = depth;
+    node.bound = bound;
+    node.best_move = best_move;
+    node.age = age;
+    uint64_t data = node.pack();
+    replace->check.store(key ^ data, std::memory_order_relaxed);
+    replace->data.store(data, std::memory_order_relaxed);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "othello_node.hpp"
+#include <atomic>
+#include <stdint.h>
+
+/*
+ * Fixed-size hash table of searched positions, keyed by Zobrist hash. The
+ * table is split into buckets of four entries; a position may live in any
+ * entry of the bucket its key selects.
+ *
+ * The table is shared by all search threads without locks. Each slot stores
+ * the packed entry and its key XORed with it, so a slot torn by two threads
+ * writing at once simply fails to match on the next probe.
+ */
+class TranspositionTable {
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> check;    // key ^ data
+        std::atomic<uint64_t> data;     // OthelloNode::pack()
+    };
+
+    Slot* slots;
+    uint64_t bucket_mask;
+    uint8_t age;
+
+public:
+    static const int bucket_size;
+
+    static int log2_entries(int megabytes);
+
+    TranspositionTable(int log2_entries);
+    ~TranspositionTable();
+
+    void clear();
+    void new_search();
+    bool probe(uint64_t key, OthelloNode* node);
+    void store(uint64_t key, int depth, int score, int bound, int best_move);
+};
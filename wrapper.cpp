@@ -1,19 +1,323 @@
 #include <iostream>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include "player.hpp"
 using namespace std;
 
+// Server mode plays many games over one stdin/stdout stream, with one
+// Player per game and a pool of worker threads shared by all of them. Each
+// line starts with a game id, any word the client likes:
+//
+//   id start Black|White   begin a game, playing the given side
+//   id X Y MS              the opponent's move (-1 -1 for none or a pass)
+//                          and our time left, as in the one-game protocol
+//   id end                 the game is over
+//
+// Each move is answered "id X Y", in the order the searches finish rather
+// than the order the moves came in; the moves of one game are played one at
+// a time, in order. Errors are answered "id error MESSAGE".
+//
+// The book and evaluation tables are loaded once and shared. Each Player
+// has its own transposition table of --hash=MB (32 by default), and when its
+// game ends it waits for the next game on the same side, so memory grows
+// with the number of games open at once, not the number played. Players are
+// set up by the worker that plays a game's first move, not by the thread
+// reading the input. A game's clock runs while its move waits for a worker,
+// so there should be about as many workers as games thinking at once.
+//
+// Statistics lines name the game they belong to, so all the games can share
+// one stats file.
+//
+// Answers are buffered, and the stream is flushed only when no other answer
+// is about to be written, so a burst of quick moves costs one write.
+
+struct Request {
+    int x, y, ms_left;
+};
+
+struct Game {
+    string id;
+    Player *player;     // Set up when its first move is played
+    int side_index;     // 0 for black, 1 for white
+    deque<Request> requests;
+    bool queued;        // Waiting for a worker or being played
+    bool ended;
+};
+
+class Server {
+public:
+    Server(int num_workers, const char *stats_file_in, SearchEngine engine_in, int tt_log2_in);
+    ~Server();
+    void run();
+
+private:
+    const char *stats_file;
+    SearchEngine engine;
+    int tt_log2;
+    vector<thread> workers;
+    vector<Player *> idle[2];
+    map<string, Game *> games;
+    deque<Game *> ready;
+    int playing;
+    bool input_done;
+    mutex lock;
+    condition_variable work_ready, all_done;
+
+    mutex output_lock;
+    atomic<int> writers;
+
+    Player *new_player(int side_index);
+    void take_player(Game *game);
+    void release(Game *game);
+    void write(const string& text);
+    string update(const string& id, const string& command, istream& words);
+    void handle(const string& line);
+    void work();
+};
+
+Server::Server(int num_workers, const char *stats_file_in, SearchEngine engine_in,
+               int tt_log2_in)
+    : stats_file(stats_file_in), engine(engine_in), tt_log2(tt_log2_in), playing(0),
+      input_done(false), writers(0) {
+    // The first Player loads what all of them share before we say we are ready.
+    idle[0].push_back(new_player(0));
+    if (num_workers <= 0) num_workers = max(1u, thread::hardware_concurrency());
+    for (int i = 0; i < num_workers; i++) workers.push_back(thread(&Server::work, this));
+}
+
+Server::~Server() {
+    {
+        lock_guard<mutex> guard(lock);
+        input_done = true;
+    }
+    work_ready.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    for (map<string, Game *>::iterator it = games.begin(); it != games.end(); ++it) {
+        delete it->second->player;
+        delete it->second;
+    }
+    for (int side = 0; side < 2; side++)
+        for (size_t i = 0; i < idle[side].size(); i++) delete idle[side][i];
+}
+
+Player *Server::new_player(int side_index) {
+    Player *player = new Player(side_index ? WHITE : BLACK, 1, engine, tt_log2);
+    if (stats_file) player->set_stats_file(stats_file);
+    return player;
+}
+
+// Gives the game an idle Player for its side, reset for a new game, or a new
+// one. Called by the worker playing its first move, without the lock, as
+// clearing or allocating a table takes a while.
+void Server::take_player(Game *game) {
+    Player *player = nullptr;
+    {
+        lock_guard<mutex> guard(lock);
+        if (!idle[game->side_index].empty()) {
+            player = idle[game->side_index].back();
+            idle[game->side_index].pop_back();
+        }
+    }
+    if (player) player->new_game();
+    else player = new_player(game->side_index);
+    player->set_board(new Board());
+    player->set_game_id(game->id);
+    game->player = player;
+}
+
+// Frees an ended game and keeps its Player, if it had one. Called with the
+// lock held.
+void Server::release(Game *game) {
+    if (game->player) idle[game->side_index].push_back(game->player);
+    delete game;
+}
+
+// Adds text to the output, and flushes it unless another thread is waiting
+// to write; the last of them flushes.
+void Server::write(const string& text) {
+    writers++;
+    lock_guard<mutex> guard(output_lock);
+    cout << text;
+    if (--writers == 0) cout.flush();
+}
+
+// Reads an integer that is the whole of word.
+static bool parse_int(const string& word, int *value) {
+    char *end;
+    errno = 0;
+    long n = strtol(word.c_str(), &end, 10);
+    if (word.empty() || *end || errno || n < INT_MIN || n > INT_MAX) return false;
+    *value = n;
+    return true;
+}
+
+// Reads a move line, "X Y MS" with X already in first, and returns whether
+// it is one: a square, both from 0 to 7, or -1 -1, and nothing after MS.
+static bool parse_request(const string& first, istream& words, Request *request) {
+    string y, ms, extra;
+    if (!(words >> y >> ms) || words >> extra) return false;
+    if (!parse_int(first, &request->x) || !parse_int(y, &request->y)
+        || !parse_int(ms, &request->ms_left)) return false;
+    if (request->x == -1 && request->y == -1) return true;
+    return request->x >= 0 && request->x < 8 && request->y >= 0 && request->y < 8;
+}
+
+// Applies one request to the games, under the lock, and returns the error
+// to answer it with, or "" if there is none.
+string Server::update(const string& id, const string& command, istream& words) {
+    lock_guard<mutex> guard(lock);
+    map<string, Game *>::iterator it = games.find(id);
+    if (command == "start") {
+        string side;
+        words >> side;
+        if (side != "Black" && side != "White") return "side must be Black or White";
+        if (it != games.end()) return "game already started";
+        Game *game = new Game();
+        game->id = id;
+        game->player = nullptr;
+        game->side_index = side == "White";
+        game->queued = false;
+        game->ended = false;
+        games[id] = game;
+        return "";
+    }
+
+    if (it == games.end()) return "no such game";
+    Game *game = it->second;
+    if (command == "end") {
+        // The id can be used again at once. Moves still waiting are dropped;
+        // one being played is finished.
+        games.erase(it);
+        game->ended = true;
+        game->requests.clear();
+        if (!game->queued) release(game);
+        return "";
+    }
+
+    Request request;
+    if (!parse_request(command, words, &request)) return "expected X Y MS";
+    game->requests.push_back(request);
+    if (!game->queued) {
+        game->queued = true;
+        ready.push_back(game);
+        work_ready.notify_one();
+    }
+    return "";
+}
+
+// Errors are written once the lock is released, so no worker waits on the
+// output to get at the games.
+void Server::handle(const string& line) {
+    istringstream words(line);
+    string id, command;
+    if (!(words >> id >> command)) return;
+    string error = update(id, command, words);
+    if (!error.empty()) write(id + " error " + error + "\n");
+}
+
+void Server::work() {
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        work_ready.wait(guard, [&]() { return !ready.empty() || input_done; });
+        if (ready.empty()) return;
+        Game *game = ready.front();
+        ready.pop_front();
+
+        // A game that ended while it waited has nothing left to play.
+        if (!game->ended) {
+            Request request = game->requests.front();
+            game->requests.pop_front();
+            playing++;
+            guard.unlock();
+
+            if (!game->player) take_player(game);
+            Move *opponents_move = nullptr;
+            if (request.x >= 0 && request.y >= 0)
+                opponents_move = new Move(request.x, request.y);
+            Move *move = game->player->doMove(opponents_move, request.ms_left);
+            ostringstream answer;
+            answer << game->id << " " << (move ? move->x : -1) << " "
+                   << (move ? move->y : -1) << "\n";
+            delete opponents_move;
+            delete move;
+            write(answer.str());
+
+            guard.lock();
+            playing--;
+        }
+        if (!game->requests.empty()) {
+            ready.push_back(game);
+            work_ready.notify_one();
+        } else {
+            game->queued = false;
+            if (game->ended) release(game);
+        }
+        if (ready.empty() && playing == 0) all_done.notify_all();
+    }
+}
+
+// Serves requests until the input ends, then waits for the moves in hand.
+void Server::run() {
+    string line;
+    while (getline(cin, line)) handle(line);
+    unique_lock<mutex> guard(lock);
+    all_done.wait(guard, [&]() { return ready.empty() && playing == 0; });
+}
+
 int main(int argc, char *argv[]) {
-    // Read in side the player is on.
-    if (argc != 2)  {
-        cerr << "usage: " << argv[0] << " side" << endl;
+    // Read in side the player is on, and optionally how many threads to use,
+    // where to write the per-move search statistics (stderr by default),
+    // --ponder to search on the opponent's time, --mcts to choose moves by
+    // Monte Carlo tree search instead of alpha-beta, and --hash=MB for the
+    // size of the transposition table. With --server there is no side, the
+    // threads are the workers shared by all the games, and each game has a
+    // table of that size.
+    bool ponder = false, serve = false;
+    int hash_mb = 32;
+    SearchEngine engine = ENGINE_ALPHA_BETA;
+    while (argc > 1 && !strncmp(argv[argc - 1], "--", 2)) {
+        if (!strcmp(argv[argc - 1], "--ponder")) ponder = true;
+        else if (!strncmp(argv[argc - 1], "--hash=", 7)) hash_mb = atoi(argv[argc - 1] + 7);
+        else if (!strcmp(argv[argc - 1], "--mcts")) engine = ENGINE_MCTS;
+        else if (!strcmp(argv[argc - 1], "--server")) serve = true;
+        else argc = 0;
+        argc--;
+    }
+    if (serve && argc >= 1 && argc <= 3 && !ponder) {
+        ios::sync_with_stdio(false);
+        cin.tie(nullptr);
+        Server *server = new Server(argc >= 2 ? atoi(argv[1]) : 0,
+            argc == 3 ? argv[2] : nullptr, engine, TranspositionTable::log2_entries(hash_mb));
+        cout << "Init done" << endl;
+        server->run();
+        delete server;
+        return 0;
+    }
+    if (serve || argc < 2 || argc > 4)  {
+        cerr << "usage: " << argv[0] << " side [threads [stats_file]] [--ponder] [--mcts]"
+             << " [--hash=MB]" << endl
+             << "       " << argv[0] << " [workers [stats_file]] --server [--mcts] [--hash=MB]"
+             << endl;
         exit(-1);
     }
     char side = (!strcmp(argv[1], "Black")) ? BLACK : WHITE;
+    int threads = (argc >= 3) ? atoi(argv[2]) : 0;
 
     // Initialize player.
-    Player *player = new Player(side);
+    Player *player = new Player(side, threads, engine, TranspositionTable::log2_entries(hash_mb));
+    if (argc == 4) player->set_stats_file(argv[3]);
+    player->set_ponder(ponder);
 
     // Tell java wrapper that we are done initializing.
     cout << "Init done" << endl;
@@ -43,5 +347,7 @@ int main(int argc, char *argv[]) {
         if (playersMove != nullptr) delete playersMove;
     }
 
+    // Stops any ponder search before exiting.
+    delete player;
     return 0;
 }